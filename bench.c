@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/time.h>
+
+#include <xdc/std.h>
+#include <ti/sdo/ce/Engine.h>
+#include <ti/sdo/ce/video3/viddec3.h>
+
+#include "dce.h"
+
+#define ERROR(FMT,...)  printf("%s:%d:\t%s\terror: " FMT "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+#define DEBUG(FMT,...)  printf("%s:%d:\t%s\tdebug: " FMT "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+
+/*
+ * Benchmark of the libdce fast paths in a loopback build (--enable-loopback),
+ * where the server side of dce.c runs in-process against a null codec.  So
+ * what is measured is the cost of libdce and the transport itself, without
+ * ducati or the codec, ie. the overhead each call adds on top of decoding.
+ */
+
+static unsigned long long usecs(void)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return (t.tv_sec * 1000000ULL) + t.tv_usec;
+}
+
+/* per-call time in ns, for n calls taking t usecs: */
+#define NS(t, n)   ((unsigned long)(((t) * 1000ULL) / (n)))
+
+int main(int argc, char **argv)
+{
+    Engine_Handle engine = NULL;
+    VIDDEC3_Handle codec = NULL;
+    VIDDEC3_Params *params = NULL;
+    XDM2_BufDesc *inBufs = NULL, *outBufs = NULL;
+    VIDDEC3_InArgs *inArgs = NULL;
+    VIDDEC3_OutArgs *outArgs = NULL;
+    Engine_Error ec;
+    unsigned long long t, t_open = 0, t_create = 0, t_delete = 0;
+    int i, walk, n = 100000, ret = 1;
+
+    if ((argc == 3) && !strcmp(argv[1], "-n")) {
+        n = atoi(argv[2]);
+    } else if (argc != 1) {
+        printf("usage:   %s [-n count]\n", argv[0]);
+        return 1;
+    }
+
+    if (n <= 0) {
+        ERROR("invalid count: %d", n);
+        return 1;
+    }
+
+    /* Engine_open()/Engine_close(): */
+    for (i = 0; i < n; i++) {
+        t = usecs();
+        engine = Engine_open("ivahd_vidsvr", NULL, &ec);
+        t_open += usecs() - t;
+
+        if (!engine) {
+            ERROR("fail: after %d, ec=%d", i, (int)ec);
+            goto out;
+        }
+
+        if (i < (n - 1)) {
+            Engine_close(engine);
+        }
+    }
+
+    params  = dce_alloc(sizeof(IVIDDEC3_Params));
+    inBufs  = dce_alloc(sizeof(XDM2_BufDesc));
+    outBufs = dce_alloc(sizeof(XDM2_BufDesc));
+    inArgs  = dce_alloc(sizeof(IVIDDEC3_InArgs));
+    outArgs = dce_alloc(sizeof(IVIDDEC3_OutArgs));
+
+    if (!params || !inBufs || !outBufs || !inArgs || !outArgs) {
+        ERROR("fail: out of memory");
+        goto out;
+    }
+
+    params->size = sizeof(IVIDDEC3_Params);
+    inArgs->size = sizeof(IVIDDEC3_InArgs);
+    outArgs->size = sizeof(IVIDDEC3_OutArgs);
+
+    /* VIDDEC3_create()/VIDDEC3_delete(), first with the server walking
+     * the heaps on every memTab alloc/free, as it used to (see
+     * dce_set_mem_walk()), then without:
+     */
+    for (walk = 1; walk >= 0; walk--) {
+        t_create = t_delete = 0;
+
+        if (dce_set_mem_walk(walk) < 0) {
+            ERROR("fail");
+            goto out;
+        }
+
+        for (i = 0; i < n; i++) {
+            t = usecs();
+            codec = VIDDEC3_create(engine, "ivahd_h264dec", params);
+            t_create += usecs() - t;
+
+            if (!codec) {
+                ERROR("fail: after %d", i);
+                goto out;
+            }
+
+            t = usecs();
+            VIDDEC3_delete(codec);
+            t_delete += usecs() - t;
+            codec = NULL;
+        }
+
+        DEBUG("%d iterations, %s: VIDDEC3_create=%luns, VIDDEC3_delete=%luns",
+                n, walk ? "heap walks" : "counters", NS(t_create, n),
+                NS(t_delete, n));
+    }
+
+    DEBUG("%d iterations: Engine_open=%luns", n, NS(t_open, n));
+
+    codec = VIDDEC3_create(engine, "ivahd_h264dec", params);
+
+    if (!codec) {
+        ERROR("fail");
+        goto out;
+    }
+
+    /* VIDDEC3_process(), each frame checked against the null codec: */
+    t = usecs();
+    for (i = 1; i <= n; i++) {
+        inArgs->inputID  = i;
+        inArgs->numBytes = i;
+
+        if (VIDDEC3_process(codec, inBufs, outBufs, inArgs, outArgs) ||
+                (outArgs->outputID[0] != i) ||
+                (outArgs->bytesConsumed != i)) {
+            ERROR("fail: frame %d", i);
+            goto out;
+        }
+    }
+    t = usecs() - t;
+
+    DEBUG("%d frames: VIDDEC3_process=%luns", n, NS(t, n));
+
+    ret = 0;
+
+out:
+    if (engine)        dce_set_mem_walk(0);
+    if (codec)         VIDDEC3_delete(codec);
+    if (outArgs)       dce_free(outArgs);
+    if (inArgs)        dce_free(inArgs);
+    if (outBufs)       dce_free(outBufs);
+    if (inBufs)        dce_free(inBufs);
+    if (params)        dce_free(params);
+    if (engine)        Engine_close(engine);
+
+    return ret;
+}
@@ -0,0 +1,881 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include <xdc/std.h>
+#include <ti/sdo/ce/Engine.h>
+#include <ti/sdo/ce/video3/viddec3.h>
+
+#include "dce.h"
+
+#define ERROR(FMT,...)  printf("%s:%d:\t%s\terror: " FMT "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+#define DEBUG(FMT,...)  printf("%s:%d:\t%s\tdebug: " FMT "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+#define DIM(a)          (sizeof((a)) / sizeof((a)[0]))
+
+/*
+ * Tests for the VIDDEC3_process() variants, run by 'make check' in the
+ * loopback build (--enable-loopback).  Each variant must give the same
+ * outArgs, frame for frame, as a plain VIDDEC3_process() on another
+ * instance of the codec.  And calls which must fail have to do so without
+ * upsetting the calls that follow.
+ */
+
+#define NFRAMES  64
+
+/* args for up to this many calls at once, ie. a batch or a full queue: */
+#define NARGS    8
+
+static Engine_Handle engine = NULL;
+static VIDDEC3_Params *params = NULL;
+
+/* what plain VIDDEC3_process() gives for each frame, see reference(): */
+static VIDDEC3_OutArgs expect[NFRAMES];
+
+/* the inArgs for frame i, different for each frame: */
+static void frame_args(VIDDEC3_InArgs *inArgs, int i)
+{
+    inArgs->size     = sizeof(VIDDEC3_InArgs);
+    inArgs->inputID  = 1000 + i;
+    inArgs->numBytes = (i * 2654435761U) % 100000;
+}
+
+/* outArgs as the caller leaves them before each call, so anything left
+ * unwritten is the same for every variant:
+ */
+static void reset_out(VIDDEC3_OutArgs *outArgs)
+{
+    memset(outArgs, 0x5a, sizeof(*outArgs));
+    outArgs->size = sizeof(VIDDEC3_OutArgs);
+}
+
+static int check_out(const char *what, int i, VIDDEC3_OutArgs *outArgs)
+{
+    VIDDEC3_OutArgs *exp = &expect[i];
+
+    if (memcmp(exp, outArgs, sizeof(*exp))) {
+        ERROR("fail: %s: frame %d: outputID=%d (expected %d), "
+                "bytesConsumed=%d (expected %d)", what, i,
+                outArgs->outputID[0], exp->outputID[0],
+                outArgs->bytesConsumed, exp->bytesConsumed);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* a codec under test, with it's own args: */
+typedef struct {
+    VIDDEC3_Handle   codec;
+    XDM2_BufDesc    *inBufs[NARGS], *outBufs[NARGS];
+    VIDDEC3_InArgs  *inArgs[NARGS];
+    VIDDEC3_OutArgs *outArgs[NARGS];
+    int              dce;         /* args from dce_alloc(), not malloc() */
+} Test;
+
+static void * test_alloc(Test *t, int sz)
+{
+    return t->dce ? dce_alloc(sz) : calloc(1, sz);
+}
+
+static void test_free(Test *t, void *ptr)
+{
+    if (t->dce) {
+        dce_free(ptr);
+    } else {
+        free(ptr);
+    }
+}
+
+static void test_delete(Test *t)
+{
+    int i;
+
+    if (t->codec) {
+        VIDDEC3_delete(t->codec);
+    }
+
+    for (i = 0; i < NARGS; i++) {
+        if (t->inBufs[i])   test_free(t, t->inBufs[i]);
+        if (t->outBufs[i])  test_free(t, t->outBufs[i]);
+        if (t->inArgs[i])   test_free(t, t->inArgs[i]);
+        if (t->outArgs[i])  test_free(t, t->outArgs[i]);
+    }
+
+    memset(t, 0, sizeof(*t));
+}
+
+static int test_create(Test *t, int dce)
+{
+    int i;
+
+    memset(t, 0, sizeof(*t));
+    t->dce = dce;
+
+    for (i = 0; i < NARGS; i++) {
+        t->inBufs[i]  = test_alloc(t, sizeof(XDM2_BufDesc));
+        t->outBufs[i] = test_alloc(t, sizeof(XDM2_BufDesc));
+        t->inArgs[i]  = test_alloc(t, sizeof(VIDDEC3_InArgs));
+        t->outArgs[i] = test_alloc(t, sizeof(VIDDEC3_OutArgs));
+        if (!t->inBufs[i] || !t->outBufs[i] || !t->inArgs[i] ||
+                !t->outArgs[i]) {
+            ERROR("fail: out of memory");
+            test_delete(t);
+            return -1;
+        }
+    }
+
+    t->codec = VIDDEC3_create(engine, "ivahd_h264dec", params);
+    if (!t->codec) {
+        ERROR("fail: could not create codec");
+        test_delete(t);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* plain VIDDEC3_process() over RCM, with dce_alloc()'d args, which the
+ * other variants are compared against:
+ */
+static int reference(void)
+{
+    Test t;
+    int i, ret = -1;
+
+    if (test_create(&t, TRUE)) {
+        return -1;
+    }
+
+    for (i = 0; i < NFRAMES; i++) {
+        frame_args(t.inArgs[0], i);
+        reset_out(t.outArgs[0]);
+
+        if (VIDDEC3_process(t.codec, t.inBufs[0], t.outBufs[0],
+                t.inArgs[0], t.outArgs[0]) != VIDDEC3_EOK) {
+            ERROR("fail: reference frame %d", i);
+            goto out;
+        }
+
+        memcpy(&expect[i], t.outArgs[0], sizeof(expect[i]));
+    }
+
+    ret = 0;
+
+out:
+    test_delete(&t);
+    return ret;
+}
+
+/* synchronous VIDDEC3_process(), in whatever mode the codec is in: */
+static int test_sync(Test *t, const char *what, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        frame_args(t->inArgs[0], i);
+        reset_out(t->outArgs[0]);
+
+        if (VIDDEC3_process(t->codec, t->inBufs[0], t->outBufs[0],
+                t->inArgs[0], t->outArgs[0]) != VIDDEC3_EOK) {
+            ERROR("fail: %s: frame %d", what, i);
+            return -1;
+        }
+
+        if (check_out(what, i, t->outArgs[0])) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* processAsync()/processWait(), with up to depth calls in flight, waited
+ * for in order:
+ */
+static int test_async(Test *t, const char *what, int depth)
+{
+    int i, sent = 0, done = 0;
+
+    if (dce_set_queue_depth(t->codec, depth)) {
+        return -1;
+    }
+
+    while (done < NFRAMES) {
+        /* keep the queue full: */
+        while ((sent < NFRAMES) && ((sent - done) < depth)) {
+            i = sent % depth;
+            frame_args(t->inArgs[i], sent);
+            reset_out(t->outArgs[i]);
+            if (VIDDEC3_processAsync(t->codec, t->inBufs[i], t->outBufs[i],
+                    t->inArgs[i], t->outArgs[i]) != VIDDEC3_EOK) {
+                ERROR("fail: %s: frame %d", what, sent);
+                return -1;
+            }
+            sent++;
+        }
+
+        i = done % depth;
+        if ((VIDDEC3_processWait(t->codec, t->inBufs[i], t->outBufs[i],
+                t->inArgs[i], t->outArgs[i], VIDDEC3_FOREVER) != VIDDEC3_EOK) ||
+                check_out(what, done, t->outArgs[i])) {
+            ERROR("fail: %s: frame %d", what, done);
+            return -1;
+        }
+        done++;
+    }
+
+    return dce_set_queue_depth(t->codec, 1);
+}
+
+/* processBatch(), in batches of 1..DCE_MAX_BATCH: */
+static int test_batch(Test *t)
+{
+    int i, n, frame = 0;
+    XDAS_Int32 processed;
+
+    for (n = 1; n <= DCE_MAX_BATCH; n++) {
+        for (i = 0; i < n; i++) {
+            frame_args(t->inArgs[i], frame + i);
+            reset_out(t->outArgs[i]);
+        }
+
+        if ((VIDDEC3_processBatch(t->codec, n, t->inBufs, t->outBufs,
+                t->inArgs, t->outArgs, &processed) != VIDDEC3_EOK) ||
+                (processed != n)) {
+            ERROR("fail: batch of %d, processed=%d", n, processed);
+            return -1;
+        }
+
+        for (i = 0; i < n; i++) {
+            if (check_out("batch", frame + i, t->outArgs[i])) {
+                return -1;
+            }
+        }
+
+        frame += n;
+    }
+
+    return 0;
+}
+
+static int test_process(void)
+{
+    Test t;
+    int ret = -1;
+
+    if (test_create(&t, TRUE)) {
+        return -1;
+    }
+
+    if (test_sync(&t, "process", NFRAMES) ||
+            test_async(&t, "async", 1) ||
+            test_async(&t, "async", DCE_MAX_QUEUE_DEPTH) ||
+            test_batch(&t)) {
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    test_delete(&t);
+    return ret;
+}
+
+/* processWait() with nothing to wait for: */
+static int test_async_errors(void)
+{
+    Test t;
+    int ret = -1;
+
+    if (test_create(&t, TRUE)) {
+        return -1;
+    }
+
+    if (VIDDEC3_processWait(t.codec, t.inBufs[0], t.outBufs[0],
+            NULL, t.outArgs[0], VIDDEC3_FOREVER) != VIDDEC3_EFAIL) {
+        ERROR("fail: processWait() with nothing in flight");
+        goto out;
+    }
+
+    if (test_sync(&t, "process", 2)) {
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    test_delete(&t);
+    return ret;
+}
+
+/* processBatch() of no frames, or more than DCE_MAX_BATCH: */
+static int test_batch_errors(void)
+{
+    Test t;
+    XDAS_Int32 processed;
+    int ret = -1;
+
+    if (test_create(&t, TRUE)) {
+        return -1;
+    }
+
+    if ((VIDDEC3_processBatch(t.codec, 0, t.inBufs, t.outBufs,
+            t.inArgs, t.outArgs, &processed) != VIDDEC3_EFAIL) ||
+            (VIDDEC3_processBatch(t.codec, DCE_MAX_BATCH + 1, t.inBufs,
+                    t.outBufs, t.inArgs, t.outArgs, &processed) !=
+                            VIDDEC3_EFAIL) || processed) {
+        ERROR("fail: invalid batch size accepted");
+        goto out;
+    }
+
+    if (test_batch(&t)) {
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    test_delete(&t);
+    return ret;
+}
+
+/* queue depths, and what is in flight at once: */
+static int test_depth_errors(void)
+{
+    Test t;
+    int i, ret = -1;
+
+    if (test_create(&t, TRUE)) {
+        return -1;
+    }
+
+    if (!dce_set_queue_depth(t.codec, 0) ||
+            !dce_set_queue_depth(t.codec, DCE_MAX_QUEUE_DEPTH + 1)) {
+        ERROR("fail: invalid queue depth accepted");
+        goto out;
+    }
+
+    if (dce_set_queue_depth(t.codec, 2)) {
+        goto out;
+    }
+
+    for (i = 0; i < 3; i++) {
+        frame_args(t.inArgs[i], i);
+        reset_out(t.outArgs[i]);
+    }
+
+    if (VIDDEC3_processAsync(t.codec, t.inBufs[0], t.outBufs[0],
+            t.inArgs[0], t.outArgs[0]) ||
+            (VIDDEC3_processAsync(t.codec, t.inBufs[0], t.outBufs[0],
+                    t.inArgs[0], t.outArgs[0]) != VIDDEC3_EFAIL)) {
+        ERROR("fail: same inputID in flight twice");
+        goto out;
+    }
+
+    if (VIDDEC3_processAsync(t.codec, t.inBufs[1], t.outBufs[1],
+            t.inArgs[1], t.outArgs[1]) ||
+            (VIDDEC3_processAsync(t.codec, t.inBufs[2], t.outBufs[2],
+                    t.inArgs[2], t.outArgs[2]) != VIDDEC3_EFAIL)) {
+        ERROR("fail: more processAsync() than queue depth");
+        goto out;
+    }
+
+    /* the newer one first, the older is reaped on the way: */
+    if (VIDDEC3_processWait(t.codec, t.inBufs[1], t.outBufs[1],
+            t.inArgs[1], t.outArgs[1], VIDDEC3_FOREVER) ||
+            check_out("async", 1, t.outArgs[1]) ||
+            VIDDEC3_processWait(t.codec, t.inBufs[0], t.outBufs[0],
+                    t.inArgs[0], t.outArgs[0], VIDDEC3_FOREVER) ||
+            check_out("async", 0, t.outArgs[0])) {
+        ERROR("fail: processWait() out of order");
+        goto out;
+    }
+
+    if (test_async(&t, "async", 2)) {
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    test_delete(&t);
+    return ret;
+}
+
+/* inline and delta args, from malloc()'d memory: */
+static int test_inline(int mode)
+{
+    const char *what = (mode == DCE_INLINE_DELTA) ? "delta" : "inline";
+    Test t;
+    int ret = -1;
+
+    if (test_create(&t, FALSE)) {
+        return -1;
+    }
+
+    t.inBufs[0]->numBufs = 1;
+    t.outBufs[0]->numBufs = 2;
+
+    if (dce_set_inline_args(t.codec, mode) ||
+            test_sync(&t, what, NFRAMES) ||
+            test_async(&t, what, 1)) {
+        goto out;
+    }
+
+    /* what changes in a delta isn't just the args: */
+    t.outBufs[0]->numBufs = 3;
+    if (test_sync(&t, what, NFRAMES)) {
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    test_delete(&t);
+    return ret;
+}
+
+static int test_inline_on(void)
+{
+    return test_inline(DCE_INLINE_ON);
+}
+
+/* no mode change with calls in flight, and inline args with bad sizes,
+ * each followed by a good call:
+ */
+static int test_inline_errors(void)
+{
+    Test t;
+    int i, ret = -1;
+
+    if (test_create(&t, TRUE)) {
+        return -1;
+    }
+
+    frame_args(t.inArgs[0], 0);
+    reset_out(t.outArgs[0]);
+
+    if (VIDDEC3_processAsync(t.codec, t.inBufs[0], t.outBufs[0],
+            t.inArgs[0], t.outArgs[0])) {
+        goto out;
+    }
+
+    if (!dce_set_inline_args(t.codec, DCE_INLINE_ON)) {
+        ERROR("fail: inline args changed with calls in flight");
+        goto out;
+    }
+
+    if (VIDDEC3_processWait(t.codec, t.inBufs[0], t.outBufs[0],
+            t.inArgs[0], t.outArgs[0], VIDDEC3_FOREVER) ||
+            check_out("async", 0, t.outArgs[0])) {
+        goto out;
+    }
+
+    if (dce_set_inline_args(t.codec, DCE_INLINE_ON)) {
+        goto out;
+    }
+
+    for (i = 0; i < 3; i++) {
+        frame_args(t.inArgs[0], i);
+        reset_out(t.outArgs[0]);
+        if (i == 0) {
+            t.inArgs[0]->size = 4;
+        } else if (i == 1) {
+            t.outArgs[0]->size = 8;
+        } else {
+            t.inArgs[0]->size = DCE_MAX_INLINE_ARGS;
+        }
+        if (VIDDEC3_process(t.codec, t.inBufs[0], t.outBufs[0],
+                t.inArgs[0], t.outArgs[0]) != VIDDEC3_EFAIL) {
+            ERROR("fail: bad inline size accepted: %d", i);
+            goto out;
+        }
+        if (test_sync(&t, "inline", 2)) {
+            goto out;
+        }
+    }
+
+    ret = 0;
+
+out:
+    test_delete(&t);
+    return ret;
+}
+
+static int test_inline_delta(void)
+{
+    return test_inline(DCE_INLINE_DELTA);
+}
+
+/* a delta that fails drops the server's state, so the next must not be
+ * applied to it.  Nor to state left over from before the codec last went
+ * through another mode:
+ */
+static int test_delta_errors(void)
+{
+    Test t;
+    int ret = -1;
+
+    if (test_create(&t, TRUE)) {
+        return -1;
+    }
+
+    if (dce_set_inline_args(t.codec, DCE_INLINE_DELTA) ||
+            test_sync(&t, "delta", 4)) {
+        goto out;
+    }
+
+    frame_args(t.inArgs[0], 5);
+    t.inArgs[0]->size = 4;
+    if (VIDDEC3_process(t.codec, t.inBufs[0], t.outBufs[0],
+            t.inArgs[0], t.outArgs[0]) != VIDDEC3_EFAIL) {
+        ERROR("fail: bad delta size accepted");
+        goto out;
+    }
+
+    frame_args(t.inArgs[0], 6);
+    reset_out(t.outArgs[0]);
+    if (VIDDEC3_process(t.codec, t.inBufs[0], t.outBufs[0],
+            t.inArgs[0], t.outArgs[0]) ||
+            check_out("delta after error", 6, t.outArgs[0])) {
+        goto out;
+    }
+
+    if (dce_set_inline_args(t.codec, DCE_INLINE_OFF) ||
+            test_sync(&t, "process", 3) ||
+            dce_set_inline_args(t.codec, DCE_INLINE_DELTA)) {
+        goto out;
+    }
+
+    frame_args(t.inArgs[0], 9);
+    reset_out(t.outArgs[0]);
+    if (VIDDEC3_process(t.codec, t.inBufs[0], t.outBufs[0],
+            t.inArgs[0], t.outArgs[0]) ||
+            check_out("delta after mode change", 9, t.outArgs[0])) {
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    test_delete(&t);
+    return ret;
+}
+
+/* a new codec, quite possibly at the same address as the one just deleted,
+ * must not inherit it's delta state:
+ */
+static int test_delta_recreate(void)
+{
+    Test t;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        if (test_create(&t, FALSE)) {
+            return -1;
+        }
+        if (dce_set_inline_args(t.codec, DCE_INLINE_DELTA) ||
+                test_sync(&t, "delta recreate", 3 + i)) {
+            test_delete(&t);
+            return -1;
+        }
+        test_delete(&t);
+    }
+
+    return 0;
+}
+
+/* with DCE_TRANSPORT=ring, plain VIDDEC3_process() goes through the ring,
+ * so doesn't touch the msg cache:
+ */
+static int test_ring(void)
+{
+    struct dce_msgcache_stats before, after;
+    Test t;
+    int ret = -1;
+
+    if (test_create(&t, TRUE)) {
+        return -1;
+    }
+
+    dce_get_msgcache_stats(&before);
+
+    if (test_sync(&t, "ring", NFRAMES)) {
+        goto out;
+    }
+
+    dce_get_msgcache_stats(&after);
+
+    if ((after.hits != before.hits) || (after.allocs != before.allocs)) {
+        ERROR("fail: ring not used: msgcache hits %u -> %u",
+                before.hits, after.hits);
+        goto out;
+    }
+
+    ret = 0;
+
+out:
+    test_delete(&t);
+    return ret;
+}
+
+/* what each codec is charged for on ducati, when several threads are
+ * creating them at once, must be the same as for a codec on it's own, and
+ * the same with the heap walks (see dce_set_mem_walk()) as without:
+ */
+static struct dce_mem_stats mem_expect;
+
+static void * mem_thread(void *arg)
+{
+    struct dce_mem_stats mem;
+    Test t;
+    int i, *err = arg;
+
+    for (i = 0, *err = 0; !*err && (i < 64); i++) {
+        *err = test_create(&t, TRUE);
+        if (*err) {
+            break;
+        }
+        *err = dce_get_mem_stats(t.codec, &mem);
+        if (!*err && memcmp(mem.codec, mem_expect.codec, sizeof(mem.codec))) {
+            ERROR("fail: codec charged heap0=%u heap1=%u, expected %u %u",
+                    mem.codec[DCE_MEM_HEAP0], mem.codec[DCE_MEM_HEAP1],
+                    mem_expect.codec[DCE_MEM_HEAP0],
+                    mem_expect.codec[DCE_MEM_HEAP1]);
+            *err = -1;
+        }
+        test_delete(&t);
+    }
+
+    return NULL;
+}
+
+static int mem_threads(void)
+{
+    pthread_t threads[8];
+    int i, n, err[DIM(threads)], ret = 0;
+
+    for (n = 0; n < DIM(threads); n++) {
+        if (pthread_create(&threads[n], NULL, mem_thread, &err[n])) {
+            ERROR("fail: could not create thread");
+            ret = -1;
+            break;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+        ret |= err[i];
+    }
+
+    return ret;
+}
+
+static int test_mem_threads(void)
+{
+    struct dce_mem_stats before, mem;
+    Test t;
+    int ret;
+
+    if (dce_get_mem_stats(NULL, &before) || test_create(&t, TRUE)) {
+        return -1;
+    }
+    ret = dce_get_mem_stats(t.codec, &mem_expect);
+    test_delete(&t);
+
+    if (ret || !mem_expect.codec[DCE_MEM_HEAP0] ||
+            !mem_expect.codec[DCE_MEM_HEAP1]) {
+        ERROR("fail: codec not charged for heap0/heap1");
+        return -1;
+    }
+
+    ret = mem_threads();
+
+    if (!ret && (dce_set_mem_walk(1) != 0)) {
+        ERROR("fail: could not enable heap walks");
+        ret = -1;
+    }
+    if (!ret) {
+        ret = mem_threads();
+    }
+    if ((dce_set_mem_walk(0) != 1) && !ret) {
+        ERROR("fail: heap walks were not enabled");
+        ret = -1;
+    }
+
+    /* and nothing left charged, once they are all deleted: */
+    if (!ret && (dce_get_mem_stats(NULL, &mem) ||
+            memcmp(mem.client, before.client, sizeof(mem.client)))) {
+        ERROR("fail: still charged heap0=%u heap1=%u",
+                mem.client[DCE_MEM_HEAP0] - before.client[DCE_MEM_HEAP0],
+                mem.client[DCE_MEM_HEAP1] - before.client[DCE_MEM_HEAP1]);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+/* several threads at once on the ring, each with it's own codec, so
+ * responses complete out of order and results[] slots get reused while
+ * other threads are still waiting:
+ */
+#define NTHREADS  8
+
+static void * ring_thread(void *arg)
+{
+    Test t;
+    int i, *err = arg;
+
+    *err = test_create(&t, TRUE);
+
+    for (i = 0; !*err && (i < 16); i++) {
+        *err = test_sync(&t, "ring thread", NFRAMES);
+    }
+
+    test_delete(&t);
+
+    return NULL;
+}
+
+static int test_ring_threads(void)
+{
+    pthread_t threads[NTHREADS];
+    int i, n, err[NTHREADS], ret = 0;
+
+    for (n = 0; n < NTHREADS; n++) {
+        if (pthread_create(&threads[n], NULL, ring_thread, &err[n])) {
+            ERROR("fail: could not create thread");
+            ret = -1;
+            break;
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        pthread_join(threads[i], NULL);
+        ret |= err[i];
+    }
+
+    return ret;
+}
+
+static int setup(void)
+{
+    Engine_Error ec;
+
+    engine = Engine_open("ivahd_vidsvr", NULL, &ec);
+    if (!engine) {
+        ERROR("fail: could not open engine: %d", (int)ec);
+        return -1;
+    }
+
+    params = dce_alloc(sizeof(*params));
+    if (!params) {
+        ERROR("fail: out of memory");
+        return -1;
+    }
+
+    params->size      = sizeof(*params);
+    params->maxWidth  = 320;
+    params->maxHeight = 240;
+
+    return 0;
+}
+
+/* undo setup(), so the next setup() starts from scratch, with a new
+ * connection to the server:
+ */
+static void teardown(void)
+{
+    if (params)       dce_free(params);
+    if (engine)       Engine_close(engine);
+
+    params = NULL;
+    engine = NULL;
+}
+
+int main(int argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        int (*fxn)(void);
+    } tests[] = {
+            { "process/async/batch", test_process },
+            { "async errors",        test_async_errors },
+            { "batch errors",        test_batch_errors },
+            { "depth errors",        test_depth_errors },
+            { "inline",              test_inline_on },
+            { "inline errors",       test_inline_errors },
+            { "delta",               test_inline_delta },
+            { "delta errors",        test_delta_errors },
+            { "delta recreate",      test_delta_recreate },
+            { "mem threads",         test_mem_threads },
+    };
+    int i, err, fails = 0;
+
+    /* over RCM (ie. the loopback transport): */
+    if (setup() || reference()) {
+        teardown();
+        return 1;
+    }
+
+    for (i = 0; i < DIM(tests); i++) {
+        err = tests[i].fxn();
+        printf("%s: %s\n", err ? "FAIL" : "PASS", tests[i].name);
+        fails += !!err;
+    }
+
+    teardown();
+
+    /* and again, from scratch, with the ring transport: */
+    setenv("DCE_TRANSPORT", "ring", 1);
+
+    if (setup()) {
+        teardown();
+        return 1;
+    }
+
+    err = test_ring();
+    printf("%s: %s\n", err ? "FAIL" : "PASS", "ring");
+    fails += !!err;
+
+    err = test_ring_threads();
+    printf("%s: %s\n", err ? "FAIL" : "PASS", "ring threads");
+    fails += !!err;
+
+    teardown();
+
+    return fails ? 1 : 0;
+}
@@ -35,16 +35,29 @@
 #include "dce_priv.h"
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 
 #ifdef SERVER
-#  include <xdc/std.h>
-#  include <xdc/runtime/System.h>
-#  include <ti/sysbios/knl/Task.h>
-#  include <ti/ipc/MultiProc.h>
-#  include <ti/sdo/rcm/RcmServer.h>
-#  include <ti/omap/slpm/slpm_interface.h>
+#  ifdef LOOPBACK
+#    include "loopback.h"
+#  else
+#    include <xdc/std.h>
+#    include <xdc/runtime/System.h>
+#    include <ti/sysbios/knl/Task.h>
+#    include <ti/ipc/MultiProc.h>
+#    include <ti/sdo/rcm/RcmServer.h>
+#    include <ti/omap/slpm/slpm_interface.h>
+#    include <ti/ipc/Notify.h>
+#    include <ti/ipc/SharedRegion.h>
+#    include <ti/sysbios/BIOS.h>
+#    include <ti/sysbios/knl/Semaphore.h>
+#    include <xdc/runtime/Memory.h>
+#    include <xdc/runtime/Timestamp.h>
+#    include <xdc/runtime/Types.h>
+#    include <xdc/cfg/global.h>
+#  endif
 #  define Rcm_Handle         RcmServer_Handle
 #  define Rcm_Params         RcmServer_Params
 #  define Rcm_init           RcmServer_init
@@ -59,45 +72,59 @@
             ERROR("failed to register function " #name ": %08x", _e);          \
             return _e;                                                         \
         }                                                                      \
+        name##__desc.idx = _f;                                                 \
+        if (nsymbols < DIM(symbols)) {                                         \
+            symbols[nsymbols++] = &name##__desc;                               \
+        }                                                                      \
     } while (0)
 #else
-#  include <Std.h>
+#  ifdef LOOPBACK
+#    include "loopback.h"
+#  else
+#    include <Std.h>
 /* arrrg..  why can't people use stdint types!! */
 typedef UInt32 Uint32;
 typedef UInt16 Uint16;
 typedef UInt8  Uint8;
 typedef UInt32 Uns;  /* WTF? */
-#  include <MultiProc.h>
-#  include <RcmClient.h>
-#  include <IpcUsr.h>
+#    include <MultiProc.h>
+#    include <RcmClient.h>
+#    include <IpcUsr.h>
+#    include <Notify.h>
+#    include <SharedRegion.h>
+#    include <Memory.h>
+#    include <memmgr.h>
+#    include <tilermem.h>
+#  endif
 #  include <sys/types.h>
 #  include <unistd.h>
 #  include <stdint.h>
 #  include <pthread.h>
-#  include <memmgr.h>
-#  include <tilermem.h>
-#  define Rcm_Handle         RcmClient_Handle
-#  define Rcm_Params         RcmClient_Params
-#  define Rcm_init           RcmClient_init
-#  define Rcm_Params_init    RcmClient_Params_init
-#  define Rcm_create         RcmClient_create
-#  define Rcm_delete         RcmClient_delete
-#  define Rcm_exit           RcmClient_exit
+#  include <sched.h>
+#  include <semaphore.h>
+#  include "dce_transport.h"
 #  define SETUP_FXN(handle, name) do {                                         \
-        int _e = RcmClient_getSymbolIndex((handle), #name, &idx_##name);       \
+        int _e = rpc_resolve(&name##__desc);                                   \
         if (_e < 0) {                                                          \
             ERROR("failed to get function " #name ": %08x", _e);               \
             return _e;                                                         \
         }                                                                      \
     } while (0)
-static void init(void);
+static int init(void);
 static void deinit(void);
 #endif
 
 #include <ti/sdo/ce/Engine.h>
 #include <ti/sdo/ce/video3/viddec3.h>
 
+#include "dce.h"
+#include "dce_ring.h"
+
+#ifdef SERVER
 static Rcm_Handle handle = NULL;
+#else
+static const Transport *transport;
+#endif
 
 /* XXX append a git hash, or version # or something like this, to ensure
  * server and client are built from same version of this code.
@@ -110,22 +137,38 @@ static Rcm_Handle handle = NULL;
  */
 
 typedef struct {
-    Uint32  size;
-    Uint32  ducati_addr;
+    Uint32      size;
+    DucatiAddr  ducati_addr;
+    void       *slab;             /* client only, NULL if not from a slab */
 } MemHeader;
 
 
 #define P2H(p) (&(((MemHeader *)(p))[-1]))
 #define H2P(h) ((void *)&(h)[1])
 
+#define CACHE_LINE      32        /* cache line size, a9 and m3 */
+
 #ifndef SERVER
 
-/**
- * Allocate a memory block that can be passed as an argument to any of the
- * CE functions.
+static UInt32 tiler_bytes = 0;    /* total allocated, for dce_get_mem_stats() */
+
+/* allocate a block that ducati can access, returns host address and ducati
+ * address of the block:
  */
-void * dce_alloc(int sz)
+static void * page_alloc(Uint32 sz, DucatiAddr *ducati_addr)
 {
+#ifdef LOOPBACK
+    /* server side is in the same process, so any memory will do, but page
+     * align it like tiler does:
+     */
+    void *p = NULL;
+    if (!posix_memalign(&p, 4096, sz)) {
+        memset(p, 0, sz);
+        __sync_add_and_fetch(&tiler_bytes, sz);
+    }
+    *ducati_addr = (DucatiAddr)p;
+    return p;
+#else
     /* TODO: for now, allocate in tiler paged mode (1d) container.. until DMM
      * is enabled on ducati, this would make the physical address the same as
      * the virtual address on ducati, which simplifies some things.  Maybe
@@ -134,657 +177,4337 @@ void * dce_alloc(int sz)
     MemAllocBlock block = {
             .pixelFormat = PIXEL_FMT_PAGE,
             .dim = {
-                    .len = sz + sizeof(MemHeader),
+                    .len = sz,
             }
     };
-    MemHeader *h = MemMgr_Alloc(&block, 1);
-
-    h->size = sz;
-    h->ducati_addr = TilerMem_VirtToPhys(H2P(h));
-
-    memset(H2P(h), 0, sz);
-
-    return H2P(h);
-}
-
-/**
- * Free a block allocated by dce_alloc()
- */
-void dce_free(void *ptr)
-{
-    MemMgr_Free(P2H(ptr));
+    void *p = MemMgr_Alloc(&block, 1);
+    if (p) {
+        *ducati_addr = TilerMem_VirtToPhys(p);
+        __sync_add_and_fetch(&tiler_bytes, sz);
+    }
+    return p;
+#endif
 }
 
-/**
- * Translate pointer address to ducati.. block should have been allocated
- * with dce_alloc().
- */
-static Uint32 virt2ducati(void *ptr)
+static void page_free(void *p, Uint32 sz)
 {
-    if (ptr)
-        return P2H(ptr)->ducati_addr;
-    return 0;
-}
-
+    __sync_sub_and_fetch(&tiler_bytes, sz);
+#ifdef LOOPBACK
+    free(p);
 #else
+    MemMgr_Free(p);
+#endif
+}
 
-/* AFAIK both TILER and heap are cached on ducati side.. so from wherever a9
- * allocates, we need to deal with cache to avoid coherency issues..
+/*
+ * Small blocks, like the various params/args structs, are sub-allocated
+ * from slabs, rather than each taking (at least) a tiler page of their
+ * own.  A slab is one page_alloc()'d block, so the ducati address of each
+ * block in it is the slab's address plus offset, without an ioctl.
  *
- * Hmm, when block is allocated, we need to somehow invalidate it.
+ * Each block starts on a cache line, with the MemHeader at the end of the
+ * preceding line, so that cache maintenance on ducati for one block never
+ * touches another.  Free blocks are linked through their first word.
+ *
+ * Since tiler memory isn't cached on the a9 side, zeroing a block is not
+ * cheap.  So freed (and new) blocks go on a 'dirty' list, and a background
+ * thread zeroes them and moves them to the 'clean' list, so that most of
+ * the time dce_alloc() finds an already zeroed block.
  */
-#include <ti/sysbios/hal/Cache.h>
 
-static void dce_clean(void *ptr)
-{
-    Cache_wbInv (ptr, P2H(ptr)->size, Cache_Type_ALL, TRUE);
-}
-#endif
+#define SLAB_SIZE       0x4000    /* 16KiB */
 
-/*
- * Tracking of memmgr's.. one per client process, so that codec's memory
- * allocates are tracked per client, and memory is freed if client crashes
- * or exits badly
- */
+static const Uint32 slab_sizes[] = { 64, 128, 256, 512, 1024, 2048 };
 
-#ifdef SERVER
+typedef struct Slab {
+    struct Slab *next;
+    char        *base;
+    DucatiAddr   ducati_addr;
+    Uint32       blksz;           /* size of each block, incl. header line */
+    Uint32       nblks;
+    Uint32       nfree;           /* clean + dirty */
+    Uint32       ndirty;
+    void        *clean;           /* free blocks, already zeroed */
+    void        *dirty;           /* free blocks, not yet zeroed */
+} Slab;
 
-#include <ti/sdo/rcm/RcmClient.h>
-#include <ti/omap/mem/MemMgr.h>
+static pthread_mutex_t slab_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  slab_cond  = PTHREAD_COND_INITIALIZER;
+static pthread_once_t  slab_once  = PTHREAD_ONCE_INIT;
+static Slab *slabs[DIM(slab_sizes)];
+static Uint32 ndirty = 0;         /* total dirty blocks, in all slabs */
 
-typedef struct {
-    Int pid;                      /* value of zero means unused */
-    Int refs;
-    Engine_Handle    engines[10]; /* adjust size per max engines per client */
-    VIDDEC3_Handle   codecs[10];  /* adjust size per max codecs per client */
-} Client;
-static Client clients[10] = {0};  /* adjust size per max-clients .. */
+#define BLK_PUSH(list, blk)  do { *(void **)(blk) = (list); (list) = (blk); } while (0)
+#define BLK_POP(list, blk)   do { (blk) = (list); (list) = *(void **)(blk); } while (0)
 
-static inline Client * get_client(Int pid)
+static void * slab_zeroer(void *arg)
 {
-    int i;
-    for (i = 0; i < DIM(clients); i++) {
-        if (clients[i].pid == pid) {
-            return &clients[i];
-        }
-    }
-    return NULL;
-}
+    pthread_mutex_lock(&slab_mutex);
 
-static void dce_register_engine(Int pid, Engine_Handle engine)
-{
-    Client *c;
+    while (TRUE) {
+        Slab *s = NULL;
+        char *blk;
+        int cls;
 
-    // TODO register/unregister should have critical section..
+        while (!ndirty) {
+            pthread_cond_wait(&slab_cond, &slab_mutex);
+        }
 
-    c = get_client(pid);
-    if (c) {
-        int i;
-        INFO("found mem client: %p refs=%d", c, c->refs);
-        c->refs++;
-        for (i = 0; i < DIM(c->engines); i++) {
-            if (c->engines[i] == NULL) {
-                c->engines[i] = engine;
-                INFO("registered engine: pid=%d engine=%p", pid, engine);
-                break;
+        for (cls = 0; (cls < DIM(slab_sizes)) && !s; cls++) {
+            for (s = slabs[cls]; s && !s->dirty; s = s->next) {
             }
         }
-    } else {
-        c = get_client(0);
-        if (!c) {
-            ERROR("too many clients");
-            goto out;
+
+        /* shouldn't happen, but rather than dereference NULL if ndirty is
+         * out of step with the slabs, resync it and wait for more:
+         */
+        if (!s) {
+            ERROR("ndirty=%d, but no dirty blocks", ndirty);
+            ndirty = 0;
+            continue;
         }
 
-        c->pid = pid;
-        c->refs = 1;
-        c->engines[0] = engine;
+        /* one block at a time, with slab_mutex held, so the slab can't be
+         * freed under us, but allocators only have to wait for one block:
+         */
+        BLK_POP(s->dirty, blk);
+        memset(blk + CACHE_LINE, 0, s->blksz - CACHE_LINE);
+        BLK_PUSH(s->clean, blk);
+        s->ndirty--;
+        ndirty--;
+
+        pthread_mutex_unlock(&slab_mutex);
+        sched_yield();
+        pthread_mutex_lock(&slab_mutex);
     }
-out:
-    // end critical section..
-    return;
+
+    return NULL;
 }
 
-static void dce_unregister_engine(Int pid, Engine_Handle engine)
+static void slab_zeroer_start(void)
 {
-    Client *c;
-
-    // TODO register/unregister should have critical section..
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, slab_zeroer, NULL)) {
+        /* not fatal, dce_alloc() zeroes dirty blocks itself: */
+        ERROR("could not start zeroing thread");
+    }
+    pthread_attr_destroy(&attr);
+}
 
-    c = get_client(pid);
-    if (c) {
-        int i;
+/* called with slab_mutex held */
+static void slab_dirtied(Uint32 n)
+{
+    ndirty += n;
+    pthread_once(&slab_once, slab_zeroer_start);
+    pthread_cond_signal(&slab_cond);
+}
 
-        INFO("found mem client: %p refs=%d", c, c->refs);
+/* called with slab_mutex held */
+static Slab * slab_new(int cls)
+{
+    Slab *s = calloc(1, sizeof(*s));
+    Uint32 i;
 
-        for (i = 0; i < DIM(c->engines); i++) {
-            if (c->engines[i] == engine) {
-                c->engines[i] = NULL;
-                INFO("unregistered engine: pid=%d engine=%p", pid, engine);
-                break;
-            }
-        }
-        c->refs--;
+    if (!s) {
+        return NULL;
+    }
 
-        if (! c->refs) {
-            c->pid = 0;
-        }
+    s->base = page_alloc(SLAB_SIZE, &s->ducati_addr);
+    if (!s->base) {
+        free(s);
+        return NULL;
     }
 
-    // end critical section..
-}
+    s->blksz = CACHE_LINE + slab_sizes[cls];
+    s->nblks = SLAB_SIZE / s->blksz;
 
-static void dce_register_codec(Int pid, VIDDEC3_Handle codec)
-{
-    Client *c;
+    for (i = 0; i < s->nblks; i++) {
+        BLK_PUSH(s->dirty, s->base + (i * s->blksz));
+    }
+    s->nfree = s->ndirty = s->nblks;
 
-    // TODO register/unregister should have critical section..
+    s->next = slabs[cls];
+    slabs[cls] = s;
 
-    c = get_client(pid);
-    if (c) {
-        int i;
-        INFO("found mem client: %p refs=%d", c, c->refs);
-        c->refs++;
-        for (i = 0; i < DIM(c->codecs); i++) {
-            if (c->codecs[i] == NULL) {
-                c->codecs[i] = codec;
-                INFO("registering codec: pid=%d codec=%p", pid, codec);
-                break;
-            }
-        }
-    }
-    // end critical section..
-    return;
+    slab_dirtied(s->nblks);
+
+    return s;
 }
 
-static void dce_unregister_codec(Int pid, VIDDEC3_Handle codec)
+static MemHeader * slab_alloc(Uint32 sz, Bool zero)
 {
-    Client *c;
+    MemHeader *h = NULL;
+    Slab *s;
+    char *blk;
+    Bool dirty;
+    int cls;
+
+    for (cls = 0; cls < DIM(slab_sizes); cls++) {
+        if (sz <= slab_sizes[cls]) {
+            break;
+        }
+    }
 
-    // TODO register/unregister should have critical section..
+    if (cls == DIM(slab_sizes)) {
+        return NULL;
+    }
 
-    c = get_client(pid);
-    if (c) {
-        int i;
+    pthread_mutex_lock(&slab_mutex);
 
-        INFO("found mem client: %p refs=%d", c, c->refs);
+    /* prefer clean blocks if zeroing is needed, otherwise dirty ones, so
+     * the clean ones are left for those that need them:
+     */
+    dirty = !zero;
+    for (s = slabs[cls]; s && !(dirty ? s->dirty : s->clean); s = s->next) {
+    }
 
-        for (i = 0; i < DIM(c->codecs); i++) {
-            if (c->codecs[i] == codec) {
-                c->codecs[i] = NULL;
-                INFO("unregistered pid=%d codec=%p", pid, codec);
-                break;
-            }
+    if (!s) {
+        dirty = !dirty;
+        for (s = slabs[cls]; s && !s->nfree; s = s->next) {
         }
-        c->refs--;
     }
 
-    // end critical section..
-}
-
-#else
-static Int pid;
-#endif
-
-/*
- * Engine_open:
- */
+    if (!s) {
+        s = slab_new(cls);
+        if (!s) {
+            goto out;
+        }
+        dirty = TRUE;
+    }
 
-typedef union {
-    struct {
-        Int    pid;
-        Char   name[25];
-        /* attrs not supported/needed yet */
-    } in;
-    struct {
-        Int    ec;
-        Uint32 engine;
-    } out;
-} Engine_open__args;
+    if (dirty && s->dirty) {
+        BLK_POP(s->dirty, blk);
+        s->ndirty--;
+        ndirty--;
+    } else {
+        BLK_POP(s->clean, blk);
+        dirty = FALSE;
+    }
+    s->nfree--;
 
-#ifdef SERVER
-static Int32 rpc_Engine_open(UInt32 size, UInt32 *data)
-{
-    Engine_open__args *args = (Engine_open__args *)data;
-    Int pid = args->in.pid;
-    Engine_Error ec;
+    h = P2H(blk + CACHE_LINE);
+    h->ducati_addr = s->ducati_addr + (blk - s->base) + CACHE_LINE;
+    h->slab = s;
 
-    DEBUG(">> name=%s", args->in.name);
-    Task_setEnv(Task_self(), (Ptr) args->in.pid);
-    args->out.engine = (Uint32)Engine_open(args->in.name, NULL, &ec);
-    args->out.ec = ec;
-    DEBUG("<< engine=%08x, ec=%d", args->out.engine, args->out.ec);
+out:
+    pthread_mutex_unlock(&slab_mutex);
 
-    if (args->out.engine) {
-        dce_register_engine(pid, (Engine_Handle)(args->out.engine));
+    if (h && dirty && zero) {
+        memset(H2P(h), 0, sz);
     }
 
-    return 0;
+    return h;
 }
-#else
-static UInt32 idx_Engine_open;
-Engine_Handle Engine_open(String name, Engine_Attrs *attrs, Engine_Error *ec)
+
+static void slab_free(MemHeader *h)
 {
-    int err;
-    Engine_Handle ret = NULL;
-    Engine_open__args *args;
-    RcmClient_Message *msg = NULL;
+    Slab *s = h->slab, **p;
+    char *blk = (char *)H2P(h) - CACHE_LINE;
+    int cls;
+
+    for (cls = 0; slab_sizes[cls] < (s->blksz - CACHE_LINE); cls++) {
+    }
 
-    init();
+    pthread_mutex_lock(&slab_mutex);
 
-    DEBUG(">> name=%s, attrs=%p", name, attrs);
+    BLK_PUSH(s->dirty, blk);
+    s->ndirty++;
+    s->nfree++;
 
-    err = RcmClient_alloc(handle, sizeof(Engine_open__args), &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
+    if (s->nfree < s->nblks) {
+        slab_dirtied(1);
         goto out;
     }
 
-    msg->fxnIdx = idx_Engine_open;
-    args = (Engine_open__args *)&(msg->data);
-    args->in.pid = pid;
-    strncpy(args->in.name, name, DIM(args->in.name)-1);
-
-    err = RcmClient_exec(handle, msg, &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
+    /* give back the tiler space of an empty slab, unless it is the only
+     * one of it's size, to avoid thrashing:
+     */
+    for (p = &slabs[cls]; *p; p = &(*p)->next) {
+        if ((*p != s) && (*p)->nfree) {
+            break;
+        }
     }
 
-    args = (Engine_open__args *)&(msg->data);
-    if (ec) {
-        *ec = args->out.ec;
+    if (*p) {
+        for (p = &slabs[cls]; *p != s; p = &(*p)->next) {
+        }
+        *p = s->next;
+        ndirty -= s->ndirty - 1;  /* the one just freed wasn't counted */
+        page_free(s->base, SLAB_SIZE);
+        free(s);
+    } else {
+        slab_dirtied(1);
     }
 
-    ret = (Engine_Handle)args->out.engine;
+out:
+    pthread_mutex_unlock(&slab_mutex);
+}
+
+static void * alloc(int sz, Bool zero)
+{
+    MemHeader *h = slab_alloc(sz, zero);
 
-    DEBUG("<< engine=%p, ec=%d", ret, args->out.ec);
+    if (!h) {
+        DucatiAddr ducati_addr;
 
-out:
-    if (msg) {
-        RcmClient_free (handle, msg);
+        h = page_alloc(sz + sizeof(MemHeader), &ducati_addr);
+        if (!h) {
+            ERROR("fail: could not allocate %d bytes", sz);
+            return NULL;
+        }
+
+        h->ducati_addr = ducati_addr + sizeof(MemHeader);
+        h->slab = NULL;
+
+        if (zero) {
+            memset(H2P(h), 0, sz);
+        }
     }
 
-    return ret;
+    h->size = sz;
+
+    return H2P(h);
 }
-#endif
 
-/*
- * Engine_close:
+/**
+ * Allocate a memory block that can be passed as an argument to any of the
+ * CE functions.
  */
-
-typedef union {
-    struct {
-        Int    pid;
-        Uint32 engine;
-    } in;
-} Engine_close__args;
-
-#ifdef SERVER
-static Int32 rpc_Engine_close(UInt32 size, UInt32 *data)
+void * dce_alloc(int sz)
 {
-    Engine_close__args *args = (Engine_close__args *)data;
+    return alloc(sz, TRUE);
+}
 
-    dce_unregister_engine(args->in.pid, (Engine_Handle)(args->in.engine));
+/**
+ * Same as dce_alloc(), but the contents of the block are undefined, for
+ * structures that the caller fully initializes itself.
+ */
+void * dce_alloc_nozero(int sz)
+{
+    return alloc(sz, FALSE);
+}
 
-    DEBUG(">> engine=%08x", args->in.engine);
-    Task_setEnv(Task_self(), (Ptr) args->in.pid);
-    Engine_close((Engine_Handle)(args->in.engine));
-    DEBUG("<<");
+/**
+ * Free a block allocated by dce_alloc()
+ */
+void dce_free(void *ptr)
+{
+    MemHeader *h = P2H(ptr);
 
-    return 0;
+    if (h->slab) {
+        slab_free(h);
+    } else {
+        page_free(h, h->size + sizeof(MemHeader));
+    }
 }
-#else
-static UInt32 idx_Engine_close;
-Void Engine_close(Engine_Handle engine)
+
+/**
+ * Allocate all the structures for a decode session as a single block.
+ * Each struct is laid out like a slab block, on it's own cache line(s)
+ * with the MemHeader in the preceding line, so each can be passed to the
+ * CE functions like any dce_alloc()'d struct.  The per-frame ones (bufs
+ * and args) are last, and adjacent, so the server can do the cache
+ * maintenance for a VIDDEC3_process() call as a single operation.  The
+ * size field of params, dynParams, status, inArgs and outArgs is set.
+ *
+ * The individual structs must not be dce_free()'d, use dce_session_free().
+ */
+int dce_session_alloc(struct dce_session *s,
+        const struct dce_session_layout *l)
 {
-    int err;
-    Engine_close__args *args;
-    RcmClient_Message *msg = NULL;
+    struct {
+        void **ptr;
+        int    sz;
+        Bool   sized;             /* starts with XDAS_Int32 size field */
+    } parts[] = {
+            { (void **)&s->params,    l && l->params    ? l->params    : sizeof(VIDDEC3_Params),        TRUE },
+            { (void **)&s->dynParams, l && l->dynParams ? l->dynParams : sizeof(VIDDEC3_DynamicParams), TRUE },
+            { (void **)&s->status,    l && l->status    ? l->status    : sizeof(VIDDEC3_Status),        TRUE },
+            { (void **)&s->inBufs,    sizeof(XDM2_BufDesc),                                             FALSE },
+            { (void **)&s->outBufs,   sizeof(XDM2_BufDesc),                                             FALSE },
+            { (void **)&s->inArgs,    l && l->inArgs    ? l->inArgs    : sizeof(VIDDEC3_InArgs),        TRUE },
+            { (void **)&s->outArgs,   l && l->outArgs   ? l->outArgs   : sizeof(VIDDEC3_OutArgs),       TRUE },
+    };
+    DucatiAddr ducati_addr;
+    UInt32 off, total = 0;
+    char *base;
+    int i;
 
-    DEBUG(">> engine=%p", engine);
+    for (i = 0; i < DIM(parts); i++) {
+        total += CACHE_LINE + ALIGN(parts[i].sz, CACHE_LINE);
+    }
 
-    err = RcmClient_alloc(handle, sizeof(Engine_close__args), &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
+    base = page_alloc(total, &ducati_addr);
+    if (!base) {
+        ERROR("fail: could not allocate %d bytes", total);
+        return -1;
     }
 
-    msg->fxnIdx = idx_Engine_close;
-    args = (Engine_close__args *)&(msg->data);
-    args->in.pid    = pid;
-    args->in.engine = (Uint32)engine;
+    /* the first cache line is unused, other than the end of it, so stash
+     * the total size for dce_session_free():
+     */
+    *(UInt32 *)base = total;
 
-    err = RcmClient_exec(handle, msg, &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
+    for (i = 0, off = 0; i < DIM(parts); i++) {
+        MemHeader *h = P2H(base + off + CACHE_LINE);
+
+        h->size = parts[i].sz;
+        h->ducati_addr = ducati_addr + off + CACHE_LINE;
+        h->slab = NULL;
+
+        memset(H2P(h), 0, parts[i].sz);
+        if (parts[i].sized) {
+            *(XDAS_Int32 *)H2P(h) = parts[i].sz;
+        }
+
+        *parts[i].ptr = H2P(h);
+        off += CACHE_LINE + ALIGN(parts[i].sz, CACHE_LINE);
     }
 
-    DEBUG("<<");
+    s->base = base;
 
-out:
-    if (msg) {
-        RcmClient_free (handle, msg);
+    return 0;
+}
+
+void dce_session_free(struct dce_session *s)
+{
+    if (s->base) {
+        page_free(s->base, *(UInt32 *)s->base);
     }
+    memset(s, 0, sizeof(*s));
+}
 
-    deinit();
+/**
+ * Translate pointer address to ducati.. block should have been allocated
+ * with dce_alloc().
+ */
+static DucatiAddr virt2ducati(void *ptr)
+{
+    if (ptr)
+        return P2H(ptr)->ducati_addr;
+    return 0;
 }
-#endif
 
 /*
- * VIDDEC3_create
+ * Registered buffers.. other than dce_alloc()'d blocks, which carry their
+ * ducati address in the MemHeader, the host doesn't know the ducati address
+ * of a buffer without asking the kernel.  So user buffers (bitstream,
+ * frames) can be registered once with dce_register_buffer(), which looks
+ * up the ducati address of each page up front.  After that, the buffer
+ * pointers in inBufs/outBufs can be host addresses, which are translated
+ * with a binary search of the registered buffers, without a syscall.
+ *
+ * The translation is done in place in the caller's XDM2_BufDesc's, and the
+ * original values are put back once the call is complete.
  */
 
-typedef union {
-    struct {
+#define BUF_PAGE        4096
+
+typedef struct {
+    uintptr_t   start, end;
+    DucatiAddr *pages;            /* ducati address of each page */
+} BufRegion;
+
+static pthread_mutex_t bufreg_mutex = PTHREAD_MUTEX_INITIALIZER;
+static BufRegion *bufregs = NULL; /* sorted by start address */
+static int nbufregs = 0, maxbufregs = 0;
+
+/* nbufregs is only changed with bufreg_mutex held, but bufs_translate()
+ * peeks at it without the lock, so it is published atomically:
+ */
+#define BUFREGS_SET(n)  __atomic_store_n(&nbufregs, (n), __ATOMIC_RELEASE)
+#define BUFREGS_PEEK()  __atomic_load_n(&nbufregs, __ATOMIC_ACQUIRE)
+
+/* ducati address of a page mapped in our address space, or 0 */
+static DucatiAddr page2ducati(void *ptr)
+{
+#ifdef LOOPBACK
+    return (DucatiAddr)ptr;
+#else
+    return TilerMem_VirtToPhys(ptr);
+#endif
+}
+
+/* index of first region ending after p, called with bufreg_mutex held */
+static int bufreg_find(uintptr_t p)
+{
+    int lo = 0, hi = nbufregs;
+
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (bufregs[mid].end <= p) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+/**
+ * Register a buffer, so that it's host address can be used in the buffer
+ * descriptors passed to VIDDEC3_process() and friends.  Returns zero on
+ * success.
+ */
+int dce_register_buffer(void *ptr, int len)
+{
+    uintptr_t start = (uintptr_t)ptr, end = start + len;
+    uintptr_t page = start & ~(uintptr_t)(BUF_PAGE - 1);
+    int i, n = (end - page + BUF_PAGE - 1) / BUF_PAGE;
+    DucatiAddr *pages;
+    int err = -1;
+
+    if (len <= 0) {
+        ERROR("fail: invalid length: %d", len);
+        return -1;
+    }
+
+    pages = malloc(n * sizeof(pages[0]));
+    if (!pages) {
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        pages[i] = page2ducati((void *)(page + (i * BUF_PAGE)));
+        if (!pages[i]) {
+            ERROR("fail: %p not mapped to ducati", (void *)(page + (i * BUF_PAGE)));
+            free(pages);
+            return -1;
+        }
+    }
+
+    pthread_mutex_lock(&bufreg_mutex);
+
+    i = bufreg_find(start);
+    if ((i < nbufregs) && (bufregs[i].start < end)) {
+        ERROR("fail: %p overlaps registered buffer %p", ptr,
+                (void *)bufregs[i].start);
+        goto out;
+    }
+
+    if (nbufregs == maxbufregs) {
+        int max = maxbufregs ? (2 * maxbufregs) : 16;
+        BufRegion *r = realloc(bufregs, max * sizeof(r[0]));
+        if (!r) {
+            goto out;
+        }
+        bufregs = r;
+        maxbufregs = max;
+    }
+
+    memmove(&bufregs[i + 1], &bufregs[i], (nbufregs - i) * sizeof(bufregs[0]));
+    bufregs[i].start = start;
+    bufregs[i].end   = end;
+    bufregs[i].pages = pages;
+    BUFREGS_SET(nbufregs + 1);
+    pages = NULL;
+    err = 0;
+
+out:
+    pthread_mutex_unlock(&bufreg_mutex);
+    free(pages);
+    return err;
+}
+
+/**
+ * Unregister a buffer registered with dce_register_buffer().  It must not
+ * be used in any call still in flight.
+ */
+int dce_unregister_buffer(void *ptr)
+{
+    int i, err = -1;
+
+    pthread_mutex_lock(&bufreg_mutex);
+
+    i = bufreg_find((uintptr_t)ptr);
+    if ((i < nbufregs) && (bufregs[i].start == (uintptr_t)ptr)) {
+        free(bufregs[i].pages);
+        memmove(&bufregs[i], &bufregs[i + 1],
+                (nbufregs - i - 1) * sizeof(bufregs[0]));
+        BUFREGS_SET(nbufregs - 1);
+        err = 0;
+    } else {
+        ERROR("fail: %p not registered", ptr);
+    }
+
+    pthread_mutex_unlock(&bufreg_mutex);
+
+    return err;
+}
+
+/* saved buffer pointers, to undo bufs_translate(): */
+typedef struct {
+    XDM2_BufDesc *desc[2];
+    UInt32        mask[2];        /* which descs[] were translated */
+    XDAS_Int8    *orig[2][XDM_MAX_IO_BUFFERS];
+} BufXlate;
+
+static void bufs_translate(BufXlate *x, XDM2_BufDesc *inBufs,
+        XDM2_BufDesc *outBufs)
+{
+    int d, i;
+
+    x->mask[0] = x->mask[1] = 0;
+
+    /* nothing registered, the common case, doesn't need the lock: */
+    if (!BUFREGS_PEEK()) {
+        return;
+    }
+
+    x->desc[0] = inBufs;
+    x->desc[1] = outBufs;
+
+    pthread_mutex_lock(&bufreg_mutex);
+    for (d = 0; d < 2; d++) {
+        XDM2_BufDesc *desc = x->desc[d];
+        if (!desc) {
+            continue;
+        }
+        for (i = 0; i < MIN((UInt32)desc->numBufs, XDM_MAX_IO_BUFFERS); i++) {
+            uintptr_t p = (uintptr_t)desc->descs[i].buf;
+            int r = bufreg_find(p);
+            if ((r < nbufregs) && (bufregs[r].start <= p)) {
+                uintptr_t off = p - (bufregs[r].start & ~(uintptr_t)(BUF_PAGE - 1));
+                x->orig[d][i] = desc->descs[i].buf;
+                x->mask[d] |= 1 << i;
+                desc->descs[i].buf = (XDAS_Int8 *)(bufregs[r].pages[off / BUF_PAGE] +
+                        (off % BUF_PAGE));
+            }
+        }
+    }
+    pthread_mutex_unlock(&bufreg_mutex);
+}
+
+static void bufs_restore(BufXlate *x)
+{
+    int d, i;
+
+    for (d = 0; d < 2; d++) {
+        for (i = 0; x->mask[d]; i++) {
+            if (x->mask[d] & (1 << i)) {
+                x->desc[d]->descs[i].buf = x->orig[d][i];
+                x->mask[d] &= ~(1 << i);
+            }
+        }
+    }
+}
+
+#else
+
+/* AFAIK both TILER and heap are cached on ducati side.. so from wherever a9
+ * allocates, we need to deal with cache to avoid coherency issues..
+ *
+ * Hmm, when block is allocated, we need to somehow invalidate it.
+ */
+#ifndef LOOPBACK
+#  include <ti/sysbios/hal/Cache.h>
+#endif
+
+/* start cache maintenance of a range, without waiting for it, see
+ * rpc_clean().  A range the server only read just needs invalidating, so
+ * the next call sees what the host writes in the meantime, a range it
+ * wrote needs writing back too.  Memory in a SharedRegion with the cache
+ * disabled needs neither:
+ */
+static Bool dce_clean(void *ptr, UInt32 size, Bool written)
+{
+    UInt16 id = SharedRegion_getId(ptr);
+
+    if ((id != SharedRegion_INVALIDREGIONID) &&
+            !SharedRegion_isCacheEnabled(id)) {
+        return FALSE;
+    }
+
+    if (written) {
+        Cache_wbInv(ptr, size, Cache_Type_ALLD, FALSE);
+    } else {
+        Cache_inv(ptr, size, Cache_Type_ALLD, FALSE);
+    }
+
+    return TRUE;
+}
+#endif
+
+/* kinds of handle, see handle_alloc() and RPC_DESC_HANDLE(): */
+#define RPC_H_ENGINE  0x8000
+#define RPC_H_CODEC   0x4000
+#define RPC_H_KIND    (RPC_H_ENGINE | RPC_H_CODEC)
+
+/*
+ * Tracking of memmgr's.. one per client process, so that codec's memory
+ * allocates are tracked per client, and memory is freed if client crashes
+ * or exits badly
+ */
+
+#ifdef SERVER
+
+#ifndef LOOPBACK
+#  include <ti/sdo/rcm/RcmClient.h>
+#  include <ti/omap/mem/MemMgr.h>
+#endif
+
+/*
+ * The registry of clients, with their engines and codecs.  Clients are
+ * found by pid, and codecs by handle, in hash tables, and each client
+ * has a list of it's codecs and engines, for cleanup.  Everything is
+ * allocated as needed, so there is no limit other than memory.  The
+ * tables and lists are only touched with Task_disable(), as several
+ * RcmServer worker tasks can be registering at once, so the entries are
+ * allocated and freed outside of that.
+ */
+
+#define CLIENT_HASH  16           /* must be power of two */
+#define CODEC_HASH   64           /* must be power of two */
+
+typedef struct Client Client;
+typedef struct ClientEngine ClientEngine;
+typedef struct ClientCodec ClientCodec;
+typedef struct Ring Ring;
+
+struct ClientEngine {
+    Engine_Handle    engine;
+    DucatiAddr       handle;      /* as seen by the client */
+    ClientEngine    *next;
+};
+
+struct ClientCodec {
+    VIDDEC3_Handle   codec;
+    DucatiAddr       handle;      /* as seen by the client */
+    Client          *client;
+    ClientCodec     *hnext;       /* in codecs[] hash chain */
+    ClientCodec     *next, *prev; /* in client's list */
+    Ptr              state;       /* VIDDEC3_processDelta() state */
+    UInt32           rate;        /* see dce_set_frame_period() */
+    UInt32           weight;      /* see dce_set_weight() */
+    UInt32           vtime;       /* see sched_enter() */
+    UInt32           mem[DCE_MEM_NUM];  /* allocated by create */
+};
+
+struct Client {
+    Int pid;
+    Int refs;                     /* engines + codecs + ring */
+    Client          *hnext;       /* in clients[] hash chain */
+    ClientEngine    *engines;
+    ClientCodec     *codecs;
+    Ring            *ring;        /* see dce_ring_attach() */
+    UInt32           mem[DCE_MEM_NUM];  /* bytes allocated */
+};
+
+static Client      *clients[CLIENT_HASH];
+static ClientCodec *codecs[CODEC_HASH];
+static UInt32       rate_total;   /* sum of codecs' rate */
+
+static inline UInt codec_hash(VIDDEC3_Handle codec)
+{
+    UInt32 h = (UInt32)(uintptr_t)codec >> 3;
+    return (h ^ (h >> 7)) & (CODEC_HASH - 1);
+}
+
+/* these must be called with Task_disable(): */
+static Client * get_client(Int pid)
+{
+    Client *c;
+    for (c = clients[pid & (CLIENT_HASH - 1)]; c; c = c->hnext) {
+        if (c->pid == pid) {
+            return c;
+        }
+    }
+    return NULL;
+}
+
+static ClientCodec * get_codec(Int pid, VIDDEC3_Handle codec)
+{
+    ClientCodec *cc;
+    for (cc = codecs[codec_hash(codec)]; cc; cc = cc->hnext) {
+        if ((cc->codec == codec) && (cc->client->pid == pid)) {
+            return cc;
+        }
+    }
+    return NULL;
+}
+
+/* drop a reference, returns the client if that was the last one, in which
+ * case it is removed from the table, to be freed by the caller:
+ */
+static Client * put_client(Client *c)
+{
+    Client **p;
+
+    if (--c->refs) {
+        return NULL;
+    }
+
+    for (p = &clients[c->pid & (CLIENT_HASH - 1)]; *p; p = &(*p)->hnext) {
+        if (*p == c) {
+            *p = c->hnext;
+            break;
+        }
+    }
+
+    return c;
+}
+
+/*
+ * Handle table.. clients only ever see engines and codecs as handles,
+ * which index this table, tagged with the generation of the slot.  The
+ * generation is bumped each time a slot is freed, so a stale handle (ie.
+ * of a codec already deleted, or from a client that since died and had
+ * it's pid recycled) is caught by a compare, rather than the server
+ * following a pointer to something that is gone.  The table grows a chunk
+ * at a time, as needed.
+ */
+
+#define HANDLE_CHUNK  64          /* slots per chunk */
+#define HANDLE_MAX    0x10000     /* 16 bits of index, 16 of generation */
+
+typedef struct {
+    UInt16  gen;
+    UInt16  kind;                 /* RPC_H_x, zero if free */
+    Int     pid;                  /* owner */
+    Ptr     obj;                  /* Engine_Handle or VIDDEC3_Handle */
+    UInt32  next;                 /* next free slot, if free */
+} HandleSlot;
+
+static HandleSlot *handles[HANDLE_MAX / HANDLE_CHUNK];
+static UInt32 nslots = 0;
+static UInt32 hfree = 0;          /* free list, slot zero is never used */
+
+#define HSLOT(i)  (&handles[(i) / HANDLE_CHUNK][(i) % HANDLE_CHUNK])
+
+/* returns zero if out of memory or handles */
+static DucatiAddr handle_alloc(Int pid, UInt16 kind, Ptr obj)
+{
+    HandleSlot *chunk = NULL;
+    DucatiAddr h = 0;
+
+    while (TRUE) {
+        UInt key = Task_disable();
+        Bool full;
+
+        if (!hfree && chunk && (nslots < HANDLE_MAX)) {
+            UInt32 i;
+            handles[nslots / HANDLE_CHUNK] = chunk;
+            for (i = HANDLE_CHUNK; i-- > 0; ) {
+                if (nslots + i) {
+                    chunk[i].next = hfree;
+                    hfree = nslots + i;
+                }
+            }
+            nslots += HANDLE_CHUNK;
+            chunk = NULL;
+        }
+
+        if (hfree) {
+            HandleSlot *hs = HSLOT(hfree);
+            h = ((DucatiAddr)hs->gen << 16) | hfree;
+            hfree = hs->next;
+            hs->kind = kind;
+            hs->pid  = pid;
+            hs->obj  = obj;
+        }
+
+        full = (nslots >= HANDLE_MAX);
+
+        Task_restore(key);
+
+        /* if we have a chunk here, someone else grew the table first: */
+        if (h || full || chunk) {
+            break;
+        }
+
+        chunk = calloc(HANDLE_CHUNK, sizeof(*chunk));
+        if (!chunk) {
+            break;
+        }
+    }
+
+    free(chunk);
+
+    if (!h) {
+        ERROR("fail: no more handles");
+    }
+
+    return h;
+}
+
+static void handle_free(DucatiAddr h)
+{
+    UInt32 idx = h & (HANDLE_MAX - 1);
+    UInt key = Task_disable();
+    HandleSlot *hs = HSLOT(idx);
+
+    hs->gen++;
+    hs->kind = 0;
+    hs->obj  = NULL;
+    hs->next = hfree;
+    hfree = idx;
+
+    Task_restore(key);
+}
+
+/* the engine or codec, if h is a valid handle of that kind, owned by pid */
+static Ptr handle_get(Int pid, UInt16 kind, DucatiAddr h)
+{
+    UInt32 idx = h & (HANDLE_MAX - 1);
+    Ptr obj = NULL;
+    UInt key = Task_disable();
+
+    if (idx && (idx < nslots)) {
+        HandleSlot *hs = HSLOT(idx);
+        if (((h >> 16) == hs->gen) && (hs->kind == kind) &&
+                (hs->pid == pid)) {
+            obj = hs->obj;
+        }
+    }
+
+    Task_restore(key);
+
+    return obj;
+}
+
+/*
+ * Memory accounting.. allocFxn()/freeFxn() and the IRES managers report
+ * what they allocate, which is charged to the client who's call is being
+ * handled (the pid is stashed in the task env by RPC_SERVER()).  What a
+ * codec allocates while being created is also charged to the codec, by
+ * way of the task doing the VIDDEC3_create(), see mem_create_begin().  So
+ * creates by several clients at once are each charged with only their own.
+ *
+ * The codec instance itself (it's memTab's, which DSKT2 allocates from
+ * heap0) isn't reported by anyone, so after the create it is asked for
+ * them, see codec_heap0(), and they are charged as heap0.
+ */
+
+typedef struct MemCreate MemCreate;
+
+struct MemCreate {
+    Task_Handle      task;        /* doing the VIDDEC3_create() */
+    UInt32           mem[DCE_MEM_NUM];
+    MemCreate       *next;
+};
+
+static MemCreate *creating = NULL;
+
+static UInt32 mem_total[DCE_MEM_NUM];
+static UInt32 mem_peak[DCE_MEM_NUM];
+static UInt32 mem_allocs[DCE_MEM_NUM];
+static UInt32 mem_failed[DCE_MEM_NUM];
+
+void dce_mem_account(int type, int delta)
+{
+    Task_Handle self = Task_self();
+    Int pid = (Int)(intptr_t)Task_getEnv(self);
+    UInt key = Task_disable();
+    Client *c = pid ? get_client(pid) : NULL;
+    MemCreate *mc;
+
+    mem_total[type] += delta;
+    if (delta > 0) {
+        mem_allocs[type]++;
+        mem_peak[type] = MAX(mem_peak[type], mem_total[type]);
+    }
+    if (c) {
+        c->mem[type] += delta;
+    }
+
+    /* there are only ever a few creates in progress: */
+    for (mc = creating; mc; mc = mc->next) {
+        if (mc->task == self) {
+            mc->mem[type] += delta;
+            break;
+        }
+    }
+
+    Task_restore(key);
+}
+
+void dce_mem_failed(int type, int size)
+{
+    UInt key = Task_disable();
+    mem_failed[type] = MAX(mem_failed[type], size);
+    Task_restore(key);
+}
+
+/* set by dce_set_mem_walk(), to compare with how it used to be done: */
+int dce_mem_walk = 0;
+
+static UInt32 heap_used(IHeap_Handle heap)
+{
+    Memory_Stats stats;
+    Memory_getStats(heap, &stats);
+    return stats.totalSize - stats.totalFreeSize;
+}
+
+/* charge what this task allocates to mc, until mem_create_end(): */
+static void mem_create_begin(MemCreate *mc)
+{
+    UInt key;
+
+    memset(mc, 0, sizeof(*mc));
+    mc->task = Task_self();
+
+    if (dce_mem_walk) {
+        INFO("heap0 used: %u", heap_used(heap0));
+    }
+
+    key = Task_disable();
+    mc->next = creating;
+    creating = mc;
+    Task_restore(key);
+}
+
+static void mem_create_end(MemCreate *mc)
+{
+    MemCreate **p;
+    UInt key = Task_disable();
+
+    for (p = &creating; *p; p = &(*p)->next) {
+        if (*p == mc) {
+            *p = mc->next;
+            break;
+        }
+    }
+
+    Task_restore(key);
+
+    if (dce_mem_walk) {
+        INFO("heap0 used: %u", heap_used(heap0));
+    }
+}
+
+/* size of the codec's memTab's, ie. what it uses of heap0: */
+static UInt32 codec_heap0(VIDDEC3_Handle codec)
+{
+    IALG_MemRec *memTab;
+    Int i, n = 0;
+    UInt32 size = 0;
+
+    if ((VISA_getAlgNumRecs((VISA_Handle)codec, &n) != VISA_EOK) || !n) {
+        return 0;
+    }
+
+    memTab = malloc(n * sizeof(*memTab));
+    if (memTab && (VISA_getAlgMemRecs((VISA_Handle)codec,
+            memTab, n, &n) == VISA_EOK)) {
+        for (i = 0; i < n; i++) {
+            size += memTab[i].size;
+        }
+    }
+    free(memTab);
+
+    return size;
+}
+
+/* returns the engine's handle, zero on failure */
+static DucatiAddr dce_register_engine(Int pid, Engine_Handle engine)
+{
+    ClientEngine *e = malloc(sizeof(*e));
+    Client *c, *nc = calloc(1, sizeof(*nc));
+    DucatiAddr h = 0;
+    UInt key;
+
+    if (e && nc) {
+        h = handle_alloc(pid, RPC_H_ENGINE, engine);
+    } else {
+        ERROR("fail: out of memory");
+    }
+
+    if (!h) {
+        free(e);
+        free(nc);
+        return 0;
+    }
+
+    key = Task_disable();
+
+    c = get_client(pid);
+    if (!c) {
+        c = nc;
+        nc = NULL;
+        c->pid = pid;
+        c->hnext = clients[pid & (CLIENT_HASH - 1)];
+        clients[pid & (CLIENT_HASH - 1)] = c;
+    }
+
+    c->refs++;
+    e->engine = engine;
+    e->handle = h;
+    e->next = c->engines;
+    c->engines = e;
+
+    Task_restore(key);
+
+    free(nc);
+
+    INFO("registered engine: pid=%d engine=%p", pid, engine);
+
+    return h;
+}
+
+static void dce_unregister_engine(Int pid, Engine_Handle engine)
+{
+    ClientEngine **p, *e = NULL;
+    Client *c, *dead = NULL;
+    UInt key = Task_disable();
+
+    c = get_client(pid);
+    if (c) {
+        for (p = &c->engines; *p; p = &(*p)->next) {
+            if ((*p)->engine == engine) {
+                e = *p;
+                *p = e->next;
+                dead = put_client(c);
+                break;
+            }
+        }
+    }
+
+    Task_restore(key);
+
+    if (e) {
+        INFO("unregistered engine: pid=%d engine=%p", pid, engine);
+        handle_free(e->handle);
+    }
+
+    free(e);
+    free(dead);
+}
+
+/* mem is what the codec allocated while being created.  Returns the
+ * codec's handle, zero on failure.
+ */
+static DucatiAddr dce_register_codec(Int pid, VIDDEC3_Handle codec,
+        UInt32 *mem)
+{
+    ClientCodec *cc = calloc(1, sizeof(*cc));
+    Client *c;
+    UInt key;
+
+    if (!cc) {
+        ERROR("fail: out of memory");
+        return 0;
+    }
+
+    cc->handle = handle_alloc(pid, RPC_H_CODEC, codec);
+    if (!cc->handle) {
+        free(cc);
+        return 0;
+    }
+
+    cc->codec = codec;
+    cc->weight = 1;
+    memcpy(cc->mem, mem, sizeof(cc->mem));
+
+    key = Task_disable();
+
+    /* the engine is registered first, so this only fails if the client
+     * is confused:
+     */
+    c = get_client(pid);
+    if (c) {
+        UInt h = codec_hash(codec);
+
+        c->refs++;
+
+        cc->client = c;
+        cc->next = c->codecs;
+        if (c->codecs) {
+            c->codecs->prev = cc;
+        }
+        c->codecs = cc;
+
+        cc->hnext = codecs[h];
+        codecs[h] = cc;
+    }
+
+    Task_restore(key);
+
+    if (!c) {
+        ERROR("fail: no engine for pid=%d", pid);
+        handle_free(cc->handle);
+        free(cc);
+        return 0;
+    }
+
+    INFO("registered codec: pid=%d codec=%p", pid, codec);
+
+    return cc->handle;
+}
+
+static void dce_unregister_codec(Int pid, VIDDEC3_Handle codec)
+{
+    ClientCodec **p, *cc = NULL;
+    Client *dead = NULL;
+    UInt32 rate = 0;
+    UInt key = Task_disable();
+
+    for (p = &codecs[codec_hash(codec)]; *p; p = &(*p)->hnext) {
+        if (((*p)->codec == codec) && ((*p)->client->pid == pid)) {
+            Client *c;
+
+            cc = *p;
+            *p = cc->hnext;
+
+            c = cc->client;
+            if (cc->next) {
+                cc->next->prev = cc->prev;
+            }
+            if (cc->prev) {
+                cc->prev->next = cc->next;
+            } else {
+                c->codecs = cc->next;
+            }
+            rate_total -= cc->rate;
+            rate = rate_total;
+            dead = put_client(c);
+            break;
+        }
+    }
+
+    Task_restore(key);
+
+    if (cc) {
+        INFO("unregistered pid=%d codec=%p", pid, codec);
+        dce_mem_account(DCE_MEM_HEAP0, -(Int)cc->mem[DCE_MEM_HEAP0]);
+        if (cc->rate) {
+            ivahd_set_rate(rate);
+        }
+        handle_free(cc->handle);
+        free(cc->state);
+        free(cc);
+    }
+
+    free(dead);
+}
+
+/* location of the per codec state pointer, NULL if codec not registered.
+ * Only the codec's own calls use it, so it stays valid until the codec is
+ * deleted.
+ */
+static Ptr * codec_state(Int pid, VIDDEC3_Handle codec)
+{
+    ClientCodec *cc;
+    UInt key = Task_disable();
+
+    cc = get_codec(pid, codec);
+
+    Task_restore(key);
+
+    return cc ? &cc->state : NULL;
+}
+
+/*
+ * IVA-HD scheduler.. there is only one IVA-HD, but the RcmServer worker
+ * tasks (and ring tasks) can have several process() calls for it at once,
+ * which would otherwise get it in whatever order they happen to run.  So
+ * calls wait in sched_enter() for it to be free, and when it is, the next
+ * to run is the one with the earliest deadline, if any have one (see
+ * dce_set_deadline()), otherwise the one whose codec has had the least
+ * IVA-HD time, scaled by its weight (see dce_set_weight()).  That is
+ * its virtual time, which only counts from when the codec last had to
+ * wait, so a codec that was idle for a while can't hog the IVA-HD.
+ */
+
+#define SCHED_SCALE   256         /* virtual time per us at weight 1 */
+
+typedef struct SchedReq SchedReq;
+
+struct SchedReq {
+    SchedReq        *next;        /* in sched_queue */
+    Int              pid;
+    VIDDEC3_Handle   codec;
+    Bool             has_deadline;
+    UInt32           deadline;    /* Timestamp */
+    UInt32           vtime;
+    UInt32           start;       /* Timestamp, when it got the IVA-HD */
+    Semaphore_Struct sem;
+};
+
+static Bool      sched_busy;
+static SchedReq *sched_queue;     /* waiting for the IVA-HD */
+static UInt32    sched_vnow;      /* virtual time of current call */
+static UInt32    sched_ts_per_us;
+
+/* with Task_disable(): */
+static Bool sched_before(SchedReq *a, SchedReq *b)
+{
+    if (a->has_deadline != b->has_deadline) {
+        return a->has_deadline;
+    }
+    if (a->has_deadline) {
+        return (Int32)(a->deadline - b->deadline) < 0;
+    }
+    return (Int32)(a->vtime - b->vtime) < 0;
+}
+
+static SchedReq * sched_pick(void)
+{
+    SchedReq **p, **best = &sched_queue;
+    SchedReq *r;
+
+    for (p = &sched_queue; *p; p = &(*p)->next) {
+        if (sched_before(*p, *best)) {
+            best = p;
+        }
+    }
+
+    r = *best;
+    *best = r->next;
+    sched_vnow = r->vtime;
+
+    return r;
+}
+
+/* wait for the IVA-HD, deadline is in us from now, or zero for none */
+static void sched_enter(SchedReq *r, Int pid, VIDDEC3_Handle codec,
+        Int32 deadline)
+{
+    ClientCodec *cc;
+    Bool wait = FALSE;
+    UInt key;
+
+    if (!sched_ts_per_us) {
+        Types_FreqHz freq;
+        Timestamp_getFreq(&freq);
+        sched_ts_per_us = MAX(freq.lo / 1000000, 1);
+    }
+
+    r->pid = pid;
+    r->codec = codec;
+    r->has_deadline = (deadline > 0);
+    r->deadline = Timestamp_get32() + (deadline * sched_ts_per_us);
+
+    key = Task_disable();
+
+    cc = get_codec(pid, codec);
+    r->vtime = sched_vnow;
+    if (cc && ((Int32)(cc->vtime - sched_vnow) > 0)) {
+        r->vtime = cc->vtime;
+    }
+
+    if (sched_busy) {
+        Semaphore_construct(&r->sem, 0, NULL);
+        r->next = sched_queue;
+        sched_queue = r;
+        wait = TRUE;
+    } else {
+        sched_busy = TRUE;
+        sched_vnow = r->vtime;
+    }
+
+    Task_restore(key);
+
+    if (wait) {
+        Semaphore_pend(Semaphore_handle(&r->sem), BIOS_WAIT_FOREVER);
+        Semaphore_destruct(&r->sem);
+    }
+
+    r->start = Timestamp_get32();
+}
+
+/* done with the IVA-HD, charge the codec and hand it over to the next */
+static void sched_exit(SchedReq *r)
+{
+    UInt32 now = Timestamp_get32();
+    UInt32 busy = (now - r->start) / sched_ts_per_us;
+    SchedReq *next = NULL;
+    ClientCodec *cc;
+    UInt key;
+
+    if (r->has_deadline && ((Int32)(now - r->deadline) > 0)) {
+        DEBUG("codec=%p missed deadline by %dus", r->codec,
+                (Int32)(now - r->deadline) / (Int32)sched_ts_per_us);
+    }
+
+    key = Task_disable();
+
+    cc = get_codec(r->pid, r->codec);
+    if (cc) {
+        cc->vtime = r->vtime + (busy * SCHED_SCALE / cc->weight);
+    }
+
+    if (sched_queue) {
+        next = sched_pick();
+    } else {
+        sched_busy = FALSE;
+    }
+
+    Task_restore(key);
+
+    if (next) {
+        Semaphore_post(Semaphore_handle(&next->sem));
+    }
+}
+
+#else
+static Int pid;
+
+/*
+ * Message cache.. rather than transport->alloc()/transport->free() around
+ * every call, messages are recycled.  There is one cache for the engine
+ * level calls, plus one per codec for the per-frame calls.
+ */
+
+#define MSGCACHE_SIZE   4         /* max cached msgs per cache */
+#define MSGCACHE_MSGSZ  64        /* min data size of allocated msgs */
+
+typedef struct {
+    pthread_mutex_t    mutex;
+    int                cnt;       /* number of cached msgs */
+    RcmClient_Message *msgs[MSGCACHE_SIZE];
+} MsgCache;
+
+#define MSGCACHE_INITIALIZER { .mutex = PTHREAD_MUTEX_INITIALIZER }
+
+static MsgCache cache = MSGCACHE_INITIALIZER;
+static struct dce_msgcache_stats msgstats;
+
+#define STAT_INC(x)  __sync_fetch_and_add(&msgstats.x, 1)
+#define STAT_GET(x)  __sync_fetch_and_add(&msgstats.x, 0)
+
+static RcmClient_Message * msg_get(MsgCache *mc, int sz)
+{
+    RcmClient_Message *msg = NULL;
+    int err;
+
+    pthread_mutex_lock(&mc->mutex);
+    if (mc->cnt == 0) {
+        STAT_INC(exhausted);
+    } else if (mc->msgs[mc->cnt - 1]->dataSize >= sz) {
+        msg = mc->msgs[--mc->cnt];
+    }
+    pthread_mutex_unlock(&mc->mutex);
+
+    if (msg) {
+        STAT_INC(hits);
+        return msg;
+    }
+
+    /* allocate a bit bigger than needed, so the msg can be recycled for
+     * other calls too:
+     */
+    STAT_INC(allocs);
+    err = transport->alloc(MAX(sz, MSGCACHE_MSGSZ), &msg);
+    if (err < 0) {
+        STAT_INC(alloc_failures);
+        ERROR("fail: %08x", err);
+        return NULL;
+    }
+
+    return msg;
+}
+
+static void msg_put(MsgCache *mc, RcmClient_Message *msg)
+{
+    pthread_mutex_lock(&mc->mutex);
+    if (mc->cnt < DIM(mc->msgs)) {
+        mc->msgs[mc->cnt++] = msg;
+        msg = NULL;
+    }
+    pthread_mutex_unlock(&mc->mutex);
+
+    if (msg) {
+        transport->free(msg);
+    }
+}
+
+static void msgcache_flush(MsgCache *mc)
+{
+    pthread_mutex_lock(&mc->mutex);
+    while (mc->cnt > 0) {
+        transport->free(mc->msgs[--mc->cnt]);
+    }
+    pthread_mutex_unlock(&mc->mutex);
+}
+
+/**
+ * Get message cache statistics.
+ */
+void dce_get_msgcache_stats(struct dce_msgcache_stats *stats)
+{
+    /* the counters are bumped atomically, without a lock, from any thread,
+     * so they are read atomically too:
+     */
+    stats->hits           = STAT_GET(hits);
+    stats->allocs         = STAT_GET(allocs);
+    stats->alloc_failures = STAT_GET(alloc_failures);
+    stats->exhausted      = STAT_GET(exhausted);
+}
+
+/*
+ * Client side codec state.. the VIDDEC3_Handle returned to the user is
+ * a pointer to one of these, which wraps the remote (ducati) handle
+ */
+
+/* state of a processAsync() call in the completion ring: */
+typedef enum {
+    SLOT_FREE = 0,                /* result already returned to user */
+    SLOT_INFLIGHT,                /* submitted, not yet reaped */
+    SLOT_DONE,                    /* reaped, waiting for processWait() */
+} SlotState;
+
+typedef struct {
+    SlotState  state;
+    UInt16     msgId;
+    XDAS_Int32 inputID;           /* key used by processWait() */
+    XDAS_Int32 ret;
+    VIDDEC3_OutArgs *outArgs;     /* to copy back to, if args inline */
+    BufXlate   xlate;             /* to undo when the call completes */
+} Slot;
+
+typedef struct {
+    DucatiAddr codec;             /* remote codec handle */
+    MsgCache cache;               /* msgs for per-codec calls */
+    int    inline_args;           /* see dce_set_inline_args() */
+    Int32  deadline;              /* see dce_set_deadline() */
+    void  *shadow;                /* InlineArgs last sent, for delta mode */
+    Bool   resync;                /* shadow not in sync with server */
+    /* ring of processAsync() calls, in submission order, oldest at head: */
+    int    depth;                 /* max calls in flight, see dce_set_queue_depth() */
+    int    head, cnt;
+    Slot   slots[DCE_MAX_QUEUE_DEPTH];
+} Codec;
+
+#define SLOT(c, n)  (&(c)->slots[((c)->head + (n)) % DIM((c)->slots)])
+
+static inline DucatiAddr codec2ducati(VIDDEC3_Handle codec)
+{
+    if (codec)
+        return ((Codec *)codec)->codec;
+    return 0;
+}
+#endif
+
+/*
+ * Remote call descriptors.. each remote function has an __args union, with
+ * 'in' and 'out' parts overlaid, and a descriptor generated by RPC_DESC()
+ * which gives the size of the args and the offsets of the args that are
+ * pointers to dce_alloc()'d memory.  The client translates these to ducati
+ * addresses before the call, and the server cleans them from the cache
+ * after, so the 'out' part must not overlap them.  All the marshalling is
+ * done generically, by rpc_call() on the client side and RPC_SERVER() on
+ * the server side, so all a new remote function needs is it's __args,
+ * descriptor, handler, and client stub.
+ *
+ * Every __args must start with 'Int pid' in the 'in' part, which also
+ * means offset zero can terminate the list of pointer offsets.
+ *
+ * By default the server assumes it wrote to all of a pointer arg, which is
+ * the safe choice, but the offsets can be or'd with flags to say how the
+ * codec really uses it, so less needs cleaning:
+ *   RPC_RD     - only read, so just invalidated, not written back
+ *   RPC_SIZED  - an XDM struct, which starts with it's size, only that
+ *                much of the block is cleaned
+ *
+ * Engines and codecs are passed as handles from the server's handle table
+ * (see handle_alloc()), not as pointers.  Functions which take one use
+ * RPC_DESC_HANDLE(), giving the offset of the arg as RPC_ENGINE() or
+ * RPC_CODEC(), and the server validates it and replaces it with the
+ * pointer before calling the handler.  If it is stale, or belongs to
+ * another client, the handler gets NULL instead, so must check, and the
+ * pointer args aren't touched.
+ */
+
+#define RPC_MAXPTRS  4
+
+typedef struct {
+    String  name;
+    UInt32  size;                 /* size of the __args */
+    UInt32  idx;                  /* remote function index, client only */
+    UInt16  ptrs[RPC_MAXPTRS+1];  /* offsets of pointer args, zero terminated */
+    UInt16  handle;               /* offset of handle arg | RPC_H_x, if any */
+    UInt16  nrep, stride;         /* pointer args repeat nrep times, every
+                                   * stride bytes, for arrays of structs */
+} RpcDesc;
+
+#define RPC_RD     0x8000
+#define RPC_SIZED  0x4000
+#define RPC_FLAGS  (RPC_RD | RPC_SIZED)
+
+#define RPC_PTR(fxn, field)  offsetof(fxn##__args, field)
+
+/* not via RPC_PTR(), which would macro expand fxn: */
+#define RPC_ENGINE(fxn, field)  (offsetof(fxn##__args, field) | RPC_H_ENGINE)
+#define RPC_CODEC(fxn, field)   (offsetof(fxn##__args, field) | RPC_H_CODEC)
+
+#define RPC_DESC_ARRAY(fxn, h, n, s, ...)                                      \
+    static RpcDesc fxn##__desc = {                                             \
+            .name   = #fxn,                                                    \
+            .size   = sizeof(fxn##__args),                                     \
+            .ptrs   = { __VA_ARGS__ },                                         \
+            .handle = (h),                                                     \
+            .nrep   = (n),                                                     \
+            .stride = (s),                                                     \
+    }
+
+/* use 0 for functions with no pointer args.  Note that fxn is not passed
+ * on to RPC_DESC_ARRAY(), as it would get macro expanded along the way:
+ */
+#define RPC_DESC(fxn, ...)                                                     \
+    static RpcDesc fxn##__desc = {                                             \
+            .name   = #fxn,                                                    \
+            .size   = sizeof(fxn##__args),                                     \
+            .ptrs   = { __VA_ARGS__ },                                         \
+            .nrep   = 1,                                                       \
+    }
+
+#define RPC_DESC_HANDLE(fxn, h, ...)                                           \
+    static RpcDesc fxn##__desc = {                                             \
+            .name   = #fxn,                                                    \
+            .size   = sizeof(fxn##__args),                                     \
+            .ptrs   = { __VA_ARGS__ },                                         \
+            .handle = (h),                                                     \
+            .nrep   = 1,                                                       \
+    }
+
+/* address of the i'th pointer arg in the r'th repetition: */
+#define RPC_ARG(d, args, r, i) \
+        ((DucatiAddr *)((char *)(args) + ((r) * (d)->stride) + \
+                ((d)->ptrs[i] & ~RPC_FLAGS)))
+
+#ifdef SERVER
+/* validate the handle arg, if any, and replace it with the pointer.  If
+ * it isn't valid, it is replaced with NULL, and FALSE returned:
+ */
+static Bool rpc_handle(RpcDesc *d, UInt32 *data)
+{
+    DucatiAddr *h;
+    Ptr obj;
+
+    if (!d->handle) {
+        return TRUE;
+    }
+
+    h = (DucatiAddr *)((char *)data + (d->handle & ~RPC_H_KIND));
+    obj = *h ? handle_get(*(Int *)data, d->handle & RPC_H_KIND, *h) : NULL;
+    if (*h && !obj) {
+        ERROR("%s: invalid handle %08x from pid=%d", d->name,
+                (UInt32)*h, *(Int *)data);
+    }
+    *h = (DucatiAddr)obj;
+
+    return obj != NULL;
+}
+
+/* the part of a pointer arg which the server used */
+static UInt32 rpc_argsize(UInt16 flags, DucatiAddr p)
+{
+    UInt32 size = P2H(p)->size;
+
+    if (flags & RPC_SIZED) {
+        XDAS_Int32 sz = *(XDAS_Int32 *)p;
+        if ((sz > 0) && ((UInt32)sz < size)) {
+            size = sz;
+        }
+    }
+
+    return size;
+}
+
+static void rpc_clean(RpcDesc *d, UInt32 *data)
+{
+    DucatiAddr start = 0, end = 0;
+    Bool written = FALSE, wait = FALSE;
+    int r, i;
+
+    /* args which follow each other in memory, separated at most by the
+     * line holding the MemHeader (ie. from dce_session_alloc()), are
+     * cleaned in one go, written back if any of them was written, as they
+     * could share a cache line.  Everything is started before waiting for
+     * any of it:
+     */
+    for (r = 0; r < d->nrep; r++) {
+        for (i = 0; d->ptrs[i]; i++) {
+            DucatiAddr p = *RPC_ARG(d, data, r, i);
+            UInt16 flags = d->ptrs[i] & RPC_FLAGS;
+            if (!p) {
+                continue;
+            }
+            if (start && (p >= end) && (p <= (end + 2 * CACHE_LINE))) {
+                end = MAX(end, p + rpc_argsize(flags, p));
+                written |= !(flags & RPC_RD);
+                continue;
+            }
+            if (start) {
+                wait |= dce_clean((void *)start, end - start, written);
+            }
+            start = p;
+            end = p + rpc_argsize(flags, p);
+            written = !(flags & RPC_RD);
+        }
+    }
+
+    if (start) {
+        wait |= dce_clean((void *)start, end - start, written);
+    }
+
+    if (wait) {
+        Cache_wait();
+    }
+}
+
+/* generates the rpc_<fxn>() which is registered with RcmServer, which
+ * takes care of the common bits and calls the <fxn>__server() handler,
+ * the body of which must follow:
+ */
+#define RPC_SERVER(fxn)                                                        \
+    static void fxn##__server(fxn##__args *args);                              \
+    static Int32 rpc_##fxn(UInt32 size, UInt32 *data)                          \
+    {                                                                          \
+        Bool valid;                                                            \
+        Task_setEnv(Task_self(), (Ptr)(intptr_t)((fxn##__args *)data)->in.pid);\
+        valid = rpc_handle(&fxn##__desc, data);                                \
+        fxn##__server((fxn##__args *)data);                                    \
+        if (valid) {                                                           \
+            rpc_clean(&fxn##__desc, data);                                     \
+        }                                                                      \
+        return 0;                                                              \
+    }                                                                          \
+    static void fxn##__server(fxn##__args *args)
+#else
+/* translate pointer args, in place, from host to ducati addresses */
+static void rpc_translate(RpcDesc *d, void *args)
+{
+    int r, i;
+
+    for (r = 0; r < d->nrep; r++) {
+        for (i = 0; d->ptrs[i]; i++) {
+            DucatiAddr *p = RPC_ARG(d, args, r, i);
+            *p = virt2ducati((void *)*p);
+        }
+    }
+}
+
+/* get a msg for the call, filled in from args (with host pointers) */
+static RcmClient_Message * rpc_msg(MsgCache *mc, RpcDesc *d, void *args)
+{
+    RcmClient_Message *msg = msg_get(mc, d->size);
+
+    if (!msg) {
+        return NULL;
+    }
+
+    msg->fxnIdx = d->idx;
+    memcpy(msg->data, args, d->size);
+    *(Int *)msg->data = pid;
+    rpc_translate(d, msg->data);
+
+    return msg;
+}
+
+/* synchronous call, on success args is updated with the result */
+static int rpc_call(MsgCache *mc, RpcDesc *d, void *args)
+{
+    int err = -1;
+    RcmClient_Message *msg = rpc_msg(mc, d, args);
+
+    if (msg) {
+        err = transport->exec(msg, &msg);
+        if (err < 0) {
+            ERROR("%s failed: %08x", d->name, err);
+        } else {
+            memcpy(args, msg->data, d->size);
+        }
+    }
+
+    if (msg) {
+        msg_put(mc, msg);
+    }
+
+    return err;
+}
+#endif
+
+/*
+ * Engine_open:
+ */
+
+typedef union {
+    struct {
+        Int        pid;
+        Char       name[25];
+        /* attrs not supported/needed yet */
+    } in;
+    struct {
+        Int        ec;
+        DucatiAddr engine;
+    } out;
+} Engine_open__args;
+
+RPC_DESC(Engine_open, 0);
+
+#ifdef SERVER
+RPC_SERVER(Engine_open)
+{
+    Int pid = args->in.pid;
+    Engine_Error ec;
+    Engine_Handle engine;
+
+    DEBUG(">> name=%s", args->in.name);
+    engine = Engine_open(args->in.name, NULL, &ec);
+    DEBUG("<< engine=%p, ec=%d", engine, ec);
+
+    args->out.engine = 0;
+    args->out.ec = ec;
+
+    if (engine) {
+        args->out.engine = dce_register_engine(pid, engine);
+        if (!args->out.engine) {
+            Engine_close(engine);
+            args->out.ec = Engine_ENOMEM;
+        }
+    }
+}
+#else
+Engine_Handle Engine_open(String name, Engine_Attrs *attrs, Engine_Error *ec)
+{
+    Engine_open__args args = {{0}};
+
+    if (init() < 0) {
+        if (ec) {
+            *ec = Engine_ERUNTIME;
+        }
+        return NULL;
+    }
+
+    DEBUG(">> name=%s, attrs=%p", name, attrs);
+
+    strncpy(args.in.name, name, DIM(args.in.name)-1);
+
+    if (rpc_call(&cache, &Engine_open__desc, &args) < 0) {
+        args.out.ec = Engine_ERUNTIME;
+        args.out.engine = 0;
+    }
+
+    if (ec) {
+        *ec = args.out.ec;
+    }
+
+    if (!args.out.engine) {
+        deinit();
+        return NULL;
+    }
+
+    DEBUG("<< engine=%p, ec=%d", (Ptr)args.out.engine, args.out.ec);
+
+    return (Engine_Handle)args.out.engine;
+}
+#endif
+
+/*
+ * Engine_close:
+ */
+
+typedef union {
+    struct {
+        Int        pid;
+        DucatiAddr engine;
+    } in;
+} Engine_close__args;
+
+RPC_DESC_HANDLE(Engine_close, RPC_ENGINE(Engine_close, in.engine), 0);
+
+#ifdef SERVER
+RPC_SERVER(Engine_close)
+{
+    if (!args->in.engine) {
+        return;
+    }
+
+    dce_unregister_engine(args->in.pid, (Engine_Handle)(args->in.engine));
+
+    DEBUG(">> engine=%p", (Ptr)args->in.engine);
+    Engine_close((Engine_Handle)(args->in.engine));
+    DEBUG("<<");
+}
+#else
+Void Engine_close(Engine_Handle engine)
+{
+    Engine_close__args args = {{0}};
+
+    DEBUG(">> engine=%p", engine);
+
+    args.in.engine = (DucatiAddr)engine;
+
+    rpc_call(&cache, &Engine_close__desc, &args);
+
+    DEBUG("<<");
+
+    deinit();
+}
+#endif
+
+/*
+ * VIDDEC3_create
+ */
+
+typedef union {
+    struct {
+        Int        pid;
+        DucatiAddr engine;
+        Char       name[25];
+        DucatiAddr params;
+    } in;
+    struct {
+        DucatiAddr codec;
+    } out;
+} VIDDEC3_create__args;
+
+RPC_DESC_HANDLE(VIDDEC3_create, RPC_ENGINE(VIDDEC3_create, in.engine),
+        RPC_PTR(VIDDEC3_create, in.params) | RPC_RD | RPC_SIZED);
+
+#ifdef SERVER
+RPC_SERVER(VIDDEC3_create)
+{
+    VIDDEC3_Params *params = (VIDDEC3_Params *)args->in.params;
+    Engine_Handle engine = (Engine_Handle)args->in.engine;
+    VIDDEC3_Handle codec;
+    Int pid = args->in.pid;
+    MemCreate mc;
+
+    if (!engine) {
+        args->out.codec = 0;
+        return;
+    }
+
+    mem_create_begin(&mc);
+
+    DEBUG(">> engine=%p, name=%s, params=%p", engine, args->in.name, params);
+    codec = VIDDEC3_create(engine, args->in.name, params);
+    DEBUG("<< codec=%p", codec);
+
+    mem_create_end(&mc);
+
+    args->out.codec = 0;
+
+    if (codec) {
+        mc.mem[DCE_MEM_HEAP0] = codec_heap0(codec);
+        dce_mem_account(DCE_MEM_HEAP0, mc.mem[DCE_MEM_HEAP0]);
+        INFO("codec=%p: heap0=%u, heap1=%u, tiled=%u", codec,
+                mc.mem[DCE_MEM_HEAP0], mc.mem[DCE_MEM_HEAP1],
+                mc.mem[DCE_MEM_TILED]);
+        args->out.codec = dce_register_codec(pid, codec, mc.mem);
+        if (!args->out.codec) {
+            dce_mem_account(DCE_MEM_HEAP0, -(Int)mc.mem[DCE_MEM_HEAP0]);
+            VIDDEC3_delete(codec);
+        }
+    }
+}
+#else
+static void delete_remote(MsgCache *mc, DucatiAddr codec);
+
+VIDDEC3_Handle VIDDEC3_create(Engine_Handle engine, String name,
+        VIDDEC3_Params *params)
+{
+    Codec *c = NULL;
+    VIDDEC3_create__args args = {{0}};
+
+    DEBUG(">> engine=%p, name=%s, params=%p", engine, name, params);
+
+    args.in.engine = (DucatiAddr)engine;
+    strncpy(args.in.name, name, DIM(args.in.name)-1);
+    args.in.params = (DucatiAddr)params;
+
+    if (rpc_call(&cache, &VIDDEC3_create__desc, &args) < 0) {
+        return NULL;
+    }
+
+    if (args.out.codec) {
+        c = calloc(1, sizeof(Codec));
+        if (!c) {
+            ERROR("fail: could not allocate codec");
+            /* don't leak the remote codec: */
+            delete_remote(&cache, args.out.codec);
+            return NULL;
+        }
+        c->codec = args.out.codec;
+        c->cache = (MsgCache)MSGCACHE_INITIALIZER;
+        c->depth = 1;
+    }
+
+    DEBUG("<< codec=%p (%p)", c, (Ptr)args.out.codec);
+
+    return (VIDDEC3_Handle)c;
+}
+#endif
+
+/*
+ * VIDDEC3_control
+ */
+
+typedef union {
+    struct {
+        Int             pid;
+        DucatiAddr      codec;
+        VIDDEC3_Cmd     id;
+        DucatiAddr      dynParams;
+        DucatiAddr      status;
+    } in;
+    struct {
+        XDAS_Int32      ret;
+    } out;
+} VIDDEC3_control__args;
+
+RPC_DESC_HANDLE(VIDDEC3_control, RPC_CODEC(VIDDEC3_control, in.codec),
+        RPC_PTR(VIDDEC3_control, in.dynParams) | RPC_RD | RPC_SIZED,
+        RPC_PTR(VIDDEC3_control, in.status) | RPC_SIZED);
+
+#ifdef SERVER
+RPC_SERVER(VIDDEC3_control)
+{
+    VIDDEC3_DynamicParams *dynParams =
+            (VIDDEC3_DynamicParams *)args->in.dynParams;
+    VIDDEC3_Status *status = (VIDDEC3_Status *)args->in.status;
+
+    if (!args->in.codec) {
+        args->out.ret = VIDDEC3_EFAIL;
+        return;
+    }
+
+    DEBUG(">> codec=%p, id=%d, dynParams=%p, status=%p",
+            (Ptr)args->in.codec, args->in.id, dynParams, status);
+    args->out.ret = (Uint32)VIDDEC3_control(
+            (VIDDEC3_Handle)args->in.codec, args->in.id, dynParams, status);
+    DEBUG("<< ret=%d", args->out.ret);
+}
+#else
+XDAS_Int32 VIDDEC3_control(VIDDEC3_Handle codec, VIDDEC3_Cmd id,
+        VIDDEC3_DynamicParams *dynParams, VIDDEC3_Status *status)
+{
+    VIDDEC3_control__args args = {{0}};
+
+    DEBUG(">> codec=%p, id=%d, dynParams=%p, status=%p",
+            codec, id, dynParams, status);
+
+    if (!codec) {
+        return VIDDEC3_EFAIL;
+    }
+
+    args.in.codec      = codec2ducati(codec);
+    args.in.id         = id;
+    args.in.dynParams  = (DucatiAddr)dynParams;
+    args.in.status     = (DucatiAddr)status;
+
+    if (rpc_call(&((Codec *)codec)->cache, &VIDDEC3_control__desc, &args) < 0) {
+        return VIDDEC3_EFAIL;
+    }
+
+    DEBUG("<< ret=%d", args.out.ret);
+
+    return args.out.ret;
+}
+#endif
+
+/*
+ * VIDDEC3_process
+ */
+
+typedef union {
+    struct {
+        Int        pid;
+        DucatiAddr codec;
+        DucatiAddr inBufs;
+        DucatiAddr outBufs;
+        DucatiAddr inArgs;
+        DucatiAddr outArgs;
+        Int32      deadline;      /* us from now, zero for none */
+    } in;
+    struct {
+        XDAS_Int32 ret;
+    } out;
+} VIDDEC3_process__args;
+
+RPC_DESC_HANDLE(VIDDEC3_process, RPC_CODEC(VIDDEC3_process, in.codec),
+        RPC_PTR(VIDDEC3_process, in.inBufs) | RPC_RD,
+        RPC_PTR(VIDDEC3_process, in.outBufs) | RPC_RD,
+        RPC_PTR(VIDDEC3_process, in.inArgs) | RPC_RD | RPC_SIZED,
+        RPC_PTR(VIDDEC3_process, in.outArgs) | RPC_SIZED);
+
+#ifdef SERVER
+RPC_SERVER(VIDDEC3_process)
+{
+    XDM2_BufDesc    *inBufs  = (XDM2_BufDesc *)args->in.inBufs;
+    XDM2_BufDesc    *outBufs = (XDM2_BufDesc *)args->in.outBufs;
+    VIDDEC3_InArgs  *inArgs  = (VIDDEC3_InArgs *)args->in.inArgs;
+    VIDDEC3_OutArgs *outArgs = (VIDDEC3_OutArgs *)args->in.outArgs;
+    VIDDEC3_Handle   codec   = (VIDDEC3_Handle)args->in.codec;
+    SchedReq r;
+
+    if (!codec) {
+        args->out.ret = VIDDEC3_EFAIL;
+        return;
+    }
+
+    DEBUG(">> codec=%p, inBufs=%p, outBufs=%p, inArgs=%p, outArgs=%p",
+            codec, inBufs, outBufs, inArgs, outArgs);
+    sched_enter(&r, args->in.pid, codec, args->in.deadline);
+    ivahd_acquire();
+    args->out.ret = (Uint32)VIDDEC3_process(
+            codec, inBufs, outBufs, inArgs, outArgs);
+    ivahd_release();
+    sched_exit(&r);
+    DEBUG("<< ret=%d", args->out.ret);
+}
+#else
+static Bool ring_enabled(void);
+static XDAS_Int32 ring_process(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs);
+static XDAS_Int32 inline_process(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs);
+static RcmClient_Message * inline_msg(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs);
+static XDAS_Int32 inline_result(RcmClient_Message *msg,
+        VIDDEC3_OutArgs *outArgs);
+static XDAS_Int32 delta_process(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs);
+
+/* fill in the args for process()/processAsync(), with host pointers */
+static void process_args(VIDDEC3_process__args *args, VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    args->in.codec   = codec2ducati(codec);
+    args->in.inBufs  = (DucatiAddr)inBufs;
+    args->in.outBufs = (DucatiAddr)outBufs;
+    args->in.inArgs  = (DucatiAddr)inArgs;
+    args->in.outArgs = (DucatiAddr)outArgs;
+    args->in.deadline = ((Codec *)codec)->deadline;
+}
+
+XDAS_Int32 VIDDEC3_process(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    XDAS_Int32 ret;
+    VIDDEC3_process__args args;
+    BufXlate x;
+
+    DEBUG(">> codec=%p, inBufs=%p, outBufs=%p, inArgs=%p, outArgs=%p",
+            codec, inBufs, outBufs, inArgs, outArgs);
+
+    if (!codec) {
+        return VIDDEC3_EFAIL;
+    }
+
+    bufs_translate(&x, inBufs, outBufs);
+
+    if (((Codec *)codec)->inline_args) {
+        if (((Codec *)codec)->inline_args == DCE_INLINE_DELTA) {
+            ret = delta_process(codec, inBufs, outBufs, inArgs, outArgs);
+        } else {
+            ret = inline_process(codec, inBufs, outBufs, inArgs, outArgs);
+        }
+    } else if (ring_enabled()) {
+        ret = ring_process(codec, inBufs, outBufs, inArgs, outArgs);
+    } else {
+        process_args(&args, codec, inBufs, outBufs, inArgs, outArgs);
+
+        if (rpc_call(&((Codec *)codec)->cache, &VIDDEC3_process__desc, &args) < 0) {
+            ret = VIDDEC3_EFAIL;
+        } else {
+            ret = args.out.ret;
+        }
+    }
+
+    bufs_restore(&x);
+
+    DEBUG("<< ret=%d", ret);
+
+    return ret;
+}
+
+/**
+ * Set the max number of VIDDEC3_processAsync() calls that can be in flight
+ * at once on a codec (default 1), up to DCE_MAX_QUEUE_DEPTH.  With a depth
+ * of more than one, each in flight call needs its own set of buffer
+ * descriptors and args, and a unique inArgs->inputID.
+ */
+int dce_set_queue_depth(VIDDEC3_Handle codec, int depth)
+{
+    Codec *c = (Codec *)codec;
+
+    if ((depth < 1) || (depth > DCE_MAX_QUEUE_DEPTH) || (depth < c->cnt)) {
+        ERROR("fail: invalid depth: %d (%d in flight)", depth, c->cnt);
+        return -1;
+    }
+
+    c->depth = depth;
+
+    return 0;
+}
+
+/**
+ * Submit a process() call without waiting for the result.  The caller must
+ * not touch the buffers and args until the matching VIDDEC3_processWait(),
+ * but is free to prepare and submit the following frames in the meantime,
+ * up to the depth set with dce_set_queue_depth().
+ */
+XDAS_Int32 VIDDEC3_processAsync(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    int i, err;
+    Codec *c = (Codec *)codec;
+    Slot *slot;
+    VIDDEC3_process__args args;
+    RcmClient_Message *msg;
+
+    DEBUG(">> codec=%p, inBufs=%p, outBufs=%p, inArgs=%p, outArgs=%p",
+            codec, inBufs, outBufs, inArgs, outArgs);
+
+    if (!c) {
+        return VIDDEC3_EFAIL;
+    }
+
+    if (c->cnt >= c->depth) {
+        ERROR("fail: too many processAsync() in flight: %d", c->cnt);
+        return VIDDEC3_EFAIL;
+    }
+
+    for (i = 0; i < c->cnt; i++) {
+        if ((SLOT(c, i)->state != SLOT_FREE) &&
+                (SLOT(c, i)->inputID == inArgs->inputID)) {
+            ERROR("fail: inputID %08x already in flight", inArgs->inputID);
+            return VIDDEC3_EFAIL;
+        }
+    }
+
+    slot = SLOT(c, c->cnt);
+
+    bufs_translate(&slot->xlate, inBufs, outBufs);
+
+    if (c->inline_args) {
+        msg = inline_msg(codec, inBufs, outBufs, inArgs, outArgs);
+        /* already copied into the msg: */
+        bufs_restore(&slot->xlate);
+    } else {
+        process_args(&args, codec, inBufs, outBufs, inArgs, outArgs);
+        msg = rpc_msg(&c->cache, &VIDDEC3_process__desc, &args);
+    }
+    if (!msg) {
+        bufs_restore(&slot->xlate);
+        return VIDDEC3_EFAIL;
+    }
+
+    /* on success, ownership of msg passes to the transport until we get
+     * it back from transport->wait()
+     */
+    err = transport->exec_nowait(msg, &slot->msgId);
+    if (err < 0) {
+        ERROR("fail: %08x", err);
+        msg_put(&c->cache, msg);
+        bufs_restore(&slot->xlate);
+        return VIDDEC3_EFAIL;
+    }
+
+    slot->state   = SLOT_INFLIGHT;
+    slot->inputID = inArgs->inputID;
+    slot->outArgs = c->inline_args ? outArgs : NULL;
+    c->cnt++;
+
+    DEBUG("<< msgId=%d, inputID=%08x, cnt=%d", slot->msgId, slot->inputID, c->cnt);
+
+    return VIDDEC3_EOK;
+}
+
+/* wait for an in flight call to complete, and stash it's result in the slot */
+static void reap(Codec *c, Slot *slot)
+{
+    int err;
+    RcmClient_Message *msg = NULL;
+
+    err = transport->wait(slot->msgId, &msg);
+    if (err < 0) {
+        ERROR("fail: %08x", err);
+        slot->ret = VIDDEC3_EFAIL;
+    } else if (slot->outArgs) {
+        slot->ret = inline_result(msg, slot->outArgs);
+    } else {
+        slot->ret = ((VIDDEC3_process__args *)&(msg->data))->out.ret;
+    }
+
+    if (msg) {
+        msg_put(&c->cache, msg);
+    }
+
+    bufs_restore(&slot->xlate);
+
+    slot->state = SLOT_DONE;
+}
+
+/**
+ * Wait for the result of a previous VIDDEC3_processAsync().  The call to
+ * wait for is identified by inArgs->inputID, or if inArgs is NULL the
+ * oldest call still in flight is used.  Calls complete on ducati in the
+ * order they were submitted, so any older calls are reaped along the way
+ * and their results held in the completion ring until they are waited for.
+ *
+ * The transport has no way to wait with a timeout, so the timeout is
+ * ignored and this always blocks until the remote process() call completes.
+ */
+XDAS_Int32 VIDDEC3_processWait(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs, UInt timeout)
+{
+    int i, n;
+    XDAS_Int32 ret;
+    Codec *c = (Codec *)codec;
+
+    if (!c) {
+        return VIDDEC3_EFAIL;
+    }
+
+    DEBUG(">> codec=%p, inArgs=%p, cnt=%d", codec, inArgs, c->cnt);
+
+    for (n = 0; n < c->cnt; n++) {
+        Slot *slot = SLOT(c, n);
+        if ((slot->state != SLOT_FREE) &&
+                (!inArgs || (slot->inputID == inArgs->inputID))) {
+            break;
+        }
+    }
+
+    if (n == c->cnt) {
+        ERROR("fail: no matching processAsync() in flight");
+        return VIDDEC3_EFAIL;
+    }
+
+    for (i = 0; i <= n; i++) {
+        if (SLOT(c, i)->state == SLOT_INFLIGHT) {
+            reap(c, SLOT(c, i));
+        }
+    }
+
+    ret = SLOT(c, n)->ret;
+    SLOT(c, n)->state = SLOT_FREE;
+
+    /* retire completed slots from the head of the ring: */
+    while (c->cnt && (SLOT(c, 0)->state == SLOT_FREE)) {
+        c->head = (c->head + 1) % DIM(c->slots);
+        c->cnt--;
+    }
+
+    DEBUG("<< ret=%d, cnt=%d", ret, c->cnt);
+
+    return ret;
+}
+#endif
+
+/*
+ * VIDDEC3_processInline.. same as VIDDEC3_process, but with the buffer
+ * descriptors and args passed by value in the message, rather than by
+ * pointer.  The outArgs are updated in place, and copied back from the
+ * reply by the client.
+ */
+
+typedef struct {
+    XDM2_BufDesc inBufs;
+    XDM2_BufDesc outBufs;
+    /* inArgs, then outArgs at next 4 byte boundary: */
+    XDAS_Int32   args[DCE_MAX_INLINE_ARGS / 4];
+} InlineArgs;
+
+#define INLINE_INARGS(a)   ((VIDDEC3_InArgs *)(a)->args)
+#define INLINE_OUTARGS(a)  ((VIDDEC3_OutArgs *)((char *)(a)->args + \
+        ALIGN(INLINE_INARGS(a)->size, 4)))
+
+typedef union {
+    struct {
+        Int          pid;
+        DucatiAddr   codec;
+        Bool         keep;        /* keep args for VIDDEC3_processDelta */
+        Int32        deadline;    /* us from now, zero for none */
+        InlineArgs   a;
+    } in;
+    struct {
+        XDAS_Int32   ret;
+    } out;
+} VIDDEC3_processInline__args;
+
+RPC_DESC_HANDLE(VIDDEC3_processInline,
+        RPC_CODEC(VIDDEC3_processInline, in.codec), 0);
+
+#ifdef SERVER
+/* the sizes come from the client, and say where outArgs is, so check that
+ * both structs are at least as big as the codec expects, and still fit in
+ * args[] before letting the codec at them:
+ */
+static Bool inline_valid(InlineArgs *a)
+{
+    XDAS_Int32 insz  = INLINE_INARGS(a)->size;
+    XDAS_Int32 outsz;
+
+    if ((insz < (XDAS_Int32)sizeof(VIDDEC3_InArgs)) ||
+            (insz > DCE_MAX_INLINE_ARGS)) {
+        ERROR("invalid inArgs size: %d", insz);
+        return FALSE;
+    }
+
+    outsz = INLINE_OUTARGS(a)->size;
+
+    if ((outsz < (XDAS_Int32)sizeof(VIDDEC3_OutArgs)) ||
+            ((ALIGN(insz, 4) + outsz) > DCE_MAX_INLINE_ARGS)) {
+        ERROR("invalid outArgs size: %d (inArgs %d)", outsz, insz);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+RPC_SERVER(VIDDEC3_processInline)
+{
+    InlineArgs *a = &args->in.a;
+    Ptr *state = NULL;
+    SchedReq r;
+
+    if (!args->in.codec) {
+        args->out.ret = VIDDEC3_EFAIL;
+        return;
+    }
+
+    DEBUG(">> codec=%p, keep=%d", (Ptr)args->in.codec, args->in.keep);
+
+    if (args->in.keep) {
+        state = codec_state(args->in.pid, (VIDDEC3_Handle)args->in.codec);
+    }
+
+    if (!inline_valid(a)) {
+        /* the client's copy won't match ours anymore, so make the next
+         * VIDDEC3_processDelta resync:
+         */
+        if (state && *state) {
+            free(*state);
+            *state = NULL;
+        }
+        args->out.ret = VIDDEC3_EFAIL;
+        return;
+    }
+
+    sched_enter(&r, args->in.pid, (VIDDEC3_Handle)args->in.codec,
+            args->in.deadline);
+    ivahd_acquire();
+    args->out.ret = (Uint32)VIDDEC3_process((VIDDEC3_Handle)args->in.codec,
+            &a->inBufs, &a->outBufs, INLINE_INARGS(a), INLINE_OUTARGS(a));
+    ivahd_release();
+    sched_exit(&r);
+
+    if (state) {
+        if (!*state) {
+            *state = malloc(sizeof(InlineArgs));
+        }
+        if (*state) {
+            memcpy(*state, a, sizeof(InlineArgs));
+        }
+    }
+
+    DEBUG("<< ret=%d", args->out.ret);
+}
+#else
+/**
+ * Pass the buffer descriptors and args for VIDDEC3_process() and
+ * VIDDEC3_processAsync() on this codec inline in the message, instead of by
+ * pointer, so they don't need to be allocated with dce_alloc().  For these
+ * small structures this is cheaper than the cache maintenance needed on
+ * ducati when they are passed by pointer.  With DCE_INLINE_DELTA, the
+ * synchronous VIDDEC3_process() only sends what changed since the last
+ * call, see VIDDEC3_processDelta.
+ */
+int dce_set_inline_args(VIDDEC3_Handle codec, int mode)
+{
+    Codec *c = (Codec *)codec;
+
+    if (c->cnt) {
+        ERROR("fail: %d processAsync() in flight", c->cnt);
+        return -1;
+    }
+
+    if ((mode == DCE_INLINE_DELTA) && !c->shadow) {
+        c->shadow = calloc(1, sizeof(InlineArgs));
+        if (!c->shadow) {
+            ERROR("fail: could not allocate shadow args");
+            return -1;
+        }
+    }
+
+    c->inline_args = mode;
+    c->resync = TRUE;
+
+    return 0;
+}
+
+static Bool inline_fits(VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    if ((ALIGN(inArgs->size, 4) + outArgs->size) > DCE_MAX_INLINE_ARGS) {
+        ERROR("fail: args too big to inline: %d + %d",
+                inArgs->size, outArgs->size);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* size of the used part of a buffer descriptor: */
+static UInt32 bufdesc_size(XDM2_BufDesc *desc)
+{
+    return offsetof(XDM2_BufDesc, descs) +
+            (MIN((UInt32)desc->numBufs, XDM_MAX_IO_BUFFERS) * sizeof(desc->descs[0]));
+}
+
+static void inline_fill(InlineArgs *a,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    memcpy(&a->inBufs, inBufs, bufdesc_size(inBufs));
+    memcpy(&a->outBufs, outBufs, bufdesc_size(outBufs));
+    memcpy(INLINE_INARGS(a), inArgs, inArgs->size);
+    memcpy(INLINE_OUTARGS(a), outArgs, outArgs->size);
+}
+
+static RcmClient_Message * inline_msg(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    Codec *c = (Codec *)codec;
+    VIDDEC3_processInline__args *args;
+    RcmClient_Message *msg;
+
+    if (!inline_fits(inArgs, outArgs)) {
+        return NULL;
+    }
+
+    msg = msg_get(&c->cache, VIDDEC3_processInline__desc.size);
+    if (!msg) {
+        return NULL;
+    }
+
+    msg->fxnIdx = VIDDEC3_processInline__desc.idx;
+    args = (VIDDEC3_processInline__args *)&(msg->data);
+    args->in.pid   = pid;
+    args->in.codec = c->codec;
+    args->in.keep  = FALSE;
+    args->in.deadline = c->deadline;
+    inline_fill(&args->in.a, inBufs, outBufs, inArgs, outArgs);
+
+    return msg;
+}
+
+static XDAS_Int32 inline_result(RcmClient_Message *msg,
+        VIDDEC3_OutArgs *outArgs)
+{
+    VIDDEC3_processInline__args *args =
+            (VIDDEC3_processInline__args *)&(msg->data);
+
+    memcpy(outArgs, INLINE_OUTARGS(&args->in.a), outArgs->size);
+
+    return args->out.ret;
+}
+
+static XDAS_Int32 inline_process(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    int err;
+    XDAS_Int32 ret = VIDDEC3_EFAIL;
+    RcmClient_Message *msg;
+
+    msg = inline_msg(codec, inBufs, outBufs, inArgs, outArgs);
+    if (!msg) {
+        return VIDDEC3_EFAIL;
+    }
+
+    err = transport->exec(msg, &msg);
+    if (err < 0) {
+        ERROR("fail: %08x", err);
+    } else {
+        ret = inline_result(msg, outArgs);
+    }
+
+    if (msg) {
+        msg_put(&((Codec *)codec)->cache, msg);
+    }
+
+    return ret;
+}
+#endif
+
+/*
+ * VIDDEC3_processDelta.. for codecs in DCE_INLINE_DELTA mode, the client
+ * and server both keep a copy of the InlineArgs from the last call, and
+ * only the words that changed are sent.  In steady state that is a handful
+ * of words (inputID, numBytes, buffer addresses).  If too much changed, or
+ * the copies could be out of sync, the client instead resyncs with a
+ * VIDDEC3_processInline call with 'keep' set.
+ *
+ * Only the synchronous VIDDEC3_process() uses this, processAsync() calls
+ * use plain VIDDEC3_processInline and don't touch the saved copies.
+ */
+
+#define DELTA_MAX    32           /* max changed words per call */
+
+typedef union {
+    struct {
+        Int          pid;
+        DucatiAddr   codec;
+        Int32        deadline;    /* us from now, zero for none */
+        Int32        n;           /* number of changed words.. */
+        UInt16       idx[DELTA_MAX]; /* ..their offsets in InlineArgs.. */
+        Uint32       val[DELTA_MAX]; /* ..and their new values */
+    } in;
+    struct {
+        XDAS_Int32   ret;
+        Int32        resync;      /* server has no saved args */
+        XDAS_Int32   outArgs[DCE_MAX_INLINE_ARGS / 4];
+    } out;
+} VIDDEC3_processDelta__args;
+
+RPC_DESC_HANDLE(VIDDEC3_processDelta,
+        RPC_CODEC(VIDDEC3_processDelta, in.codec), 0);
+
+#ifdef SERVER
+RPC_SERVER(VIDDEC3_processDelta)
+{
+    VIDDEC3_Handle codec = (VIDDEC3_Handle)args->in.codec;
+    Ptr *state = codec_state(args->in.pid, codec);
+    InlineArgs *a;
+    XDAS_Int32 ret;
+    Int i;
+    SchedReq r;
+
+    DEBUG(">> codec=%p, n=%d", codec, args->in.n);
+
+    if (!state || !*state) {
+        ERROR("no saved args for codec=%p", codec);
+        args->out.resync = TRUE;
+        args->out.ret = VIDDEC3_EFAIL;
+        return;
+    }
+
+    a = *state;
+    for (i = 0; i < MIN(args->in.n, DELTA_MAX); i++) {
+        if (args->in.idx[i] < (sizeof(InlineArgs) / 4)) {
+            ((Uint32 *)a)[args->in.idx[i]] = args->in.val[i];
+        }
+    }
+
+    /* the delta can change the sizes too.  If they are bad, there are no
+     * outArgs to send back, so drop our copy and have the client resync,
+     * which fails the same way in VIDDEC3_processInline:
+     */
+    if (!inline_valid(a)) {
+        free(*state);
+        *state = NULL;
+        args->out.resync = TRUE;
+        args->out.ret = VIDDEC3_EFAIL;
+        return;
+    }
+
+    sched_enter(&r, args->in.pid, codec, args->in.deadline);
+    ivahd_acquire();
+    ret = VIDDEC3_process(codec, &a->inBufs, &a->outBufs,
+            INLINE_INARGS(a), INLINE_OUTARGS(a));
+    ivahd_release();
+    sched_exit(&r);
+
+    /* the in part of args is overwritten from here on: */
+    memcpy(args->out.outArgs, INLINE_OUTARGS(a),
+            MIN(INLINE_OUTARGS(a)->size, sizeof(args->out.outArgs)));
+    args->out.resync = FALSE;
+    args->out.ret = ret;
+
+    DEBUG("<< ret=%d", args->out.ret);
+}
+#else
+/* add the words of src that differ from the shadow copy at dst to the delta,
+ * updating the shadow copy.  Returns FALSE if the delta overflows.
+ */
+static Bool delta_add(VIDDEC3_processDelta__args *args, InlineArgs *shadow,
+        void *dst, const void *src, UInt32 sz)
+{
+    Uint32 *d = dst;
+    const Uint32 *s = src;
+    UInt32 i, base = d - (Uint32 *)shadow;
+
+    /* usually most, if not all, of it is unchanged: */
+    if (!memcmp(d, s, sz)) {
+        return TRUE;
+    }
+
+    for (i = 0; i < (sz + 3) / 4; i++) {
+        if (d[i] != s[i]) {
+            if (args->in.n == DELTA_MAX) {
+                return FALSE;
+            }
+            d[i] = s[i];
+            args->in.idx[args->in.n] = base + i;
+            args->in.val[args->in.n] = s[i];
+            args->in.n++;
+        }
+    }
+
+    return TRUE;
+}
+
+/* full VIDDEC3_processInline call, which also resyncs the server's copy */
+static XDAS_Int32 delta_resync(Codec *c,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    InlineArgs *shadow = c->shadow;
+    VIDDEC3_processInline__args *args;
+    RcmClient_Message *msg;
+    XDAS_Int32 ret = VIDDEC3_EFAIL;
+    int err;
+
+    msg = msg_get(&c->cache, VIDDEC3_processInline__desc.size);
+    if (!msg) {
+        return VIDDEC3_EFAIL;
+    }
+
+    /* all of the shadow copy is sent, so that even the unused parts match
+     * the server's copy:
+     */
+    inline_fill(shadow, inBufs, outBufs, inArgs, outArgs);
+
+    msg->fxnIdx = VIDDEC3_processInline__desc.idx;
+    args = (VIDDEC3_processInline__args *)&(msg->data);
+    args->in.pid   = pid;
+    args->in.codec = c->codec;
+    args->in.keep  = TRUE;
+    args->in.deadline = c->deadline;
+    memcpy(&args->in.a, shadow, sizeof(InlineArgs));
+
+    err = transport->exec(msg, &msg);
+    if (err < 0) {
+        ERROR("fail: %08x", err);
+    } else {
+        ret = inline_result(msg, outArgs);
+        memcpy(INLINE_OUTARGS(shadow), outArgs, outArgs->size);
+        c->resync = FALSE;
+    }
+
+    if (msg) {
+        msg_put(&c->cache, msg);
+    }
+
+    return ret;
+}
+
+static XDAS_Int32 delta_process(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    Codec *c = (Codec *)codec;
+    InlineArgs *shadow = c->shadow;
+    VIDDEC3_processDelta__args *args;
+    RcmClient_Message *msg;
+    XDAS_Int32 ret = VIDDEC3_EFAIL;
+    Bool ok;
+    int err;
+
+    if (!inline_fits(inArgs, outArgs)) {
+        return VIDDEC3_EFAIL;
+    }
+
+    if (c->resync) {
+        return delta_resync(c, inBufs, outBufs, inArgs, outArgs);
+    }
+
+    msg = msg_get(&c->cache, VIDDEC3_processDelta__desc.size);
+    if (!msg) {
+        return VIDDEC3_EFAIL;
+    }
+
+    msg->fxnIdx = VIDDEC3_processDelta__desc.idx;
+    args = (VIDDEC3_processDelta__args *)&(msg->data);
+    args->in.pid   = pid;
+    args->in.codec = c->codec;
+    args->in.n     = 0;
+    args->in.deadline = c->deadline;
+
+    /* note that inArgs->size must be diff'd before outArgs is located: */
+    ok = delta_add(args, shadow, &shadow->inBufs, inBufs, bufdesc_size(inBufs)) &&
+         delta_add(args, shadow, &shadow->outBufs, outBufs, bufdesc_size(outBufs)) &&
+         delta_add(args, shadow, INLINE_INARGS(shadow), inArgs, inArgs->size) &&
+         delta_add(args, shadow, INLINE_OUTARGS(shadow), outArgs, outArgs->size);
+
+    if (!ok) {
+        msg_put(&c->cache, msg);
+        return delta_resync(c, inBufs, outBufs, inArgs, outArgs);
+    }
+
+    err = transport->exec(msg, &msg);
+    if (err < 0) {
+        ERROR("fail: %08x", err);
+        c->resync = TRUE;
+    } else {
+        args = (VIDDEC3_processDelta__args *)&(msg->data);
+        if (args->out.resync) {
+            c->resync = TRUE;
+        } else {
+            memcpy(outArgs, args->out.outArgs, outArgs->size);
+            memcpy(INLINE_OUTARGS(shadow), outArgs, outArgs->size);
+            ret = args->out.ret;
+        }
+    }
+
+    if (msg) {
+        msg_put(&c->cache, msg);
+    }
+
+    /* if the server lost it's copy, try again the slow way: */
+    if (c->resync && (err >= 0)) {
+        return delta_resync(c, inBufs, outBufs, inArgs, outArgs);
+    }
+
+    return ret;
+}
+#endif
+
+/*
+ * VIDDEC3_processBatch
+ */
+
+typedef union {
+    struct {
+        Int        pid;
+        DucatiAddr codec;
+        XDAS_Int32 n;
+        Int32      deadline;      /* us from now, zero for none */
+        struct {
+            DucatiAddr inBufs;
+            DucatiAddr outBufs;
+            DucatiAddr inArgs;
+            DucatiAddr outArgs;
+        } frames[DCE_MAX_BATCH];
+    } in;
+    struct {
+        XDAS_Int32 ret;
+        XDAS_Int32 processed;
+    } out;
+} VIDDEC3_processBatch__args;
+
+RPC_DESC_ARRAY(VIDDEC3_processBatch,
+        RPC_CODEC(VIDDEC3_processBatch, in.codec), DCE_MAX_BATCH,
+        sizeof(((VIDDEC3_processBatch__args *)0)->in.frames[0]),
+        RPC_PTR(VIDDEC3_processBatch, in.frames[0].inBufs) | RPC_RD,
+        RPC_PTR(VIDDEC3_processBatch, in.frames[0].outBufs) | RPC_RD,
+        RPC_PTR(VIDDEC3_processBatch, in.frames[0].inArgs) | RPC_RD | RPC_SIZED,
+        RPC_PTR(VIDDEC3_processBatch, in.frames[0].outArgs) | RPC_SIZED);
+
+#ifdef SERVER
+RPC_SERVER(VIDDEC3_processBatch)
+{
+    VIDDEC3_Handle codec = (VIDDEC3_Handle)args->in.codec;
+    XDAS_Int32 ret = VIDDEC3_EOK;
+    Int i, n = MIN(args->in.n, DCE_MAX_BATCH);
+    SchedReq r;
+
+    if (!codec) {
+        args->out.ret = VIDDEC3_EFAIL;
+        args->out.processed = 0;
+        return;
+    }
+
+    DEBUG(">> codec=%p, n=%d", codec, n);
+    sched_enter(&r, args->in.pid, codec, args->in.deadline);
+    ivahd_acquire();
+    for (i = 0; (i < n) && (ret == VIDDEC3_EOK); i++) {
+        XDM2_BufDesc    *inBufs  = (XDM2_BufDesc *)args->in.frames[i].inBufs;
+        XDM2_BufDesc    *outBufs = (XDM2_BufDesc *)args->in.frames[i].outBufs;
+        VIDDEC3_InArgs  *inArgs  = (VIDDEC3_InArgs *)args->in.frames[i].inArgs;
+        VIDDEC3_OutArgs *outArgs = (VIDDEC3_OutArgs *)args->in.frames[i].outArgs;
+
+        ret = VIDDEC3_process(codec, inBufs, outBufs, inArgs, outArgs);
+    }
+    ivahd_release();
+    sched_exit(&r);
+    args->out.ret = ret;
+    args->out.processed = i;
+    DEBUG("<< ret=%d, processed=%d", args->out.ret, args->out.processed);
+}
+#else
+/**
+ * Decode up to DCE_MAX_BATCH frames in a single round trip to ducati, for
+ * when throughput matters more than per-frame latency.  Frames are decoded
+ * in order, stopping at the first one that returns an error.  If non-NULL,
+ * 'processed' returns the number of frames passed to the codec, including
+ * the failing one.
+ */
+XDAS_Int32 VIDDEC3_processBatch(VIDDEC3_Handle codec, XDAS_Int32 n,
+        XDM2_BufDesc *inBufs[], XDM2_BufDesc *outBufs[],
+        VIDDEC3_InArgs *inArgs[], VIDDEC3_OutArgs *outArgs[],
+        XDAS_Int32 *processed)
+{
+    int i;
+    VIDDEC3_processBatch__args args = {{0}};
+    BufXlate x[DCE_MAX_BATCH];
+    XDAS_Int32 ret = VIDDEC3_EFAIL;
+
+    DEBUG(">> codec=%p, n=%d", codec, n);
+
+    if (processed) {
+        *processed = 0;
+    }
+
+    if (!codec) {
+        return VIDDEC3_EFAIL;
+    }
+
+    if ((n < 1) || (n > DCE_MAX_BATCH)) {
+        ERROR("fail: invalid batch size: %d", n);
+        return VIDDEC3_EFAIL;
+    }
+
+    args.in.codec = codec2ducati(codec);
+    args.in.n     = n;
+    args.in.deadline = ((Codec *)codec)->deadline;
+    for (i = 0; i < n; i++) {
+        args.in.frames[i].inBufs  = (DucatiAddr)inBufs[i];
+        args.in.frames[i].outBufs = (DucatiAddr)outBufs[i];
+        args.in.frames[i].inArgs  = (DucatiAddr)inArgs[i];
+        args.in.frames[i].outArgs = (DucatiAddr)outArgs[i];
+        bufs_translate(&x[i], inBufs[i], outBufs[i]);
+    }
+
+    if (rpc_call(&((Codec *)codec)->cache, &VIDDEC3_processBatch__desc, &args) >= 0) {
+        if (processed) {
+            *processed = args.out.processed;
+        }
+        ret = args.out.ret;
+    }
+
+    /* in reverse, in case the same descriptors are used more than once: */
+    for (i = n - 1; i >= 0; i--) {
+        bufs_restore(&x[i]);
+    }
+
+    DEBUG("<< ret=%d, processed=%d", ret, args.out.processed);
+
+    return ret;
+}
+#endif
+
+/*
+ * VIDDEC3_delete
+ */
+
+typedef union {
+    struct {
+        Int        pid;
+        DucatiAddr codec;
+    } in;
+} VIDDEC3_delete__args;
+
+RPC_DESC_HANDLE(VIDDEC3_delete, RPC_CODEC(VIDDEC3_delete, in.codec), 0);
+
+#ifdef SERVER
+RPC_SERVER(VIDDEC3_delete)
+{
+    if (!args->in.codec) {
+        return;
+    }
+
+    dce_unregister_codec(args->in.pid, (VIDDEC3_Handle)(args->in.codec));
+
+    DEBUG(">> codec=%p", (Ptr)args->in.codec);
+    VIDDEC3_delete((VIDDEC3_Handle)(args->in.codec));
+    DEBUG("<<");
+}
+#else
+static void delete_remote(MsgCache *mc, DucatiAddr codec)
+{
+    VIDDEC3_delete__args args = {{0}};
+
+    args.in.codec = codec;
+
+    rpc_call(mc, &VIDDEC3_delete__desc, &args);
+}
+
+Void VIDDEC3_delete(VIDDEC3_Handle codec)
+{
+    DEBUG(">> codec=%p", codec);
+
+    if (!codec) {
+        return;
+    }
+
+    /* don't leave processAsync()'s dangling when the codec goes away */
+    while (((Codec *)codec)->cnt) {
+        VIDDEC3_processWait(codec, NULL, NULL, NULL, NULL, VIDDEC3_FOREVER);
+    }
+
+    delete_remote(&((Codec *)codec)->cache, codec2ducati(codec));
+
+    DEBUG("<<");
+
+    msgcache_flush(&((Codec *)codec)->cache);
+    free(((Codec *)codec)->shadow);
+    free(codec);
+}
+#endif
+
+/*
+ * Ring transport.. an optional fast path for VIDDEC3_process(), where the
+ * request and response are passed through a pair of lock-free SPSC rings
+ * (see dce_ring.h) in shared memory, instead of through RCM/MessageQ.  It
+ * is enabled on the client with DCE_TRANSPORT=ring in the environment.  All
+ * the other calls, including processAsync()/processBatch(), still go
+ * through RCM, so don't mix VIDDEC3_process() with those on the same codec.
+ * Codecs with inline args (see dce_set_inline_args()) don't use the ring.
+ * In loopback, the shared memory, doorbells and ring tasks are all stand-ins
+ * from loopback.c, within the one process.
+ */
+
+#define RING_SRID    1            /* ipc_shm2 SharedRegion */
+#define RING_EVENT   12           /* XXX Notify event id, don't collide w/ syslink */
+#define RING_NSLOTS  16
+
+typedef struct {
+    Uint32                seq;    /* the host's results[] slot */
+    VIDDEC3_process__args args;
+} RingMsg;
+
+/* the request ring is followed by the response ring: */
+#define RING_SIZE    ALIGN(DCE_RING_SIZE(RING_NSLOTS, sizeof(RingMsg)), \
+                            DCE_RING_CACHELINE)
+#define REQ_RING(p)  ((DceRing *)(p))
+#define RSP_RING(p)  ((DceRing *)((char *)(p) + RING_SIZE))
+
+typedef union {
+    struct {
+        Int    pid;
+        Uint32 rings;             /* SharedRegion_SRPtr to the rings */
+    } in;
+    struct {
+        Int32  ret;
+    } out;
+} dce_ring_attach__args;
+
+typedef union {
+    struct {
         Int    pid;
-        Uint32 engine;
-        Char   name[25];
-        Uint32 params;
+    } in;
+} dce_ring_detach__args;
+
+RPC_DESC(dce_ring_attach, 0);
+RPC_DESC(dce_ring_detach, 0);
+
+#ifdef SERVER
+/* hangs off the client's registry entry, see dce_ring_attach(): */
+struct Ring {
+    Int              pid;
+    DceRing         *req, *rsp;
+    Bool             stop;
+    Semaphore_Handle doorbell;
+    Semaphore_Handle done;        /* posted when task exits */
+    Task_Handle      task;
+};
+static UInt16 hostId;
+
+/* doorbell from host, payload is the pid of the client */
+static Void ring_notify(UInt16 procId, UInt16 lineId,
+        UInt32 eventId, UArg arg, UInt32 payload)
+{
+    UInt key = Task_disable();
+    Client *c = get_client(payload);
+
+    if (c && c->ring) {
+        Semaphore_post(c->ring->doorbell);
+    }
+
+    Task_restore(key);
+}
+
+static Void ring_task(UArg arg0, UArg arg1)
+{
+    /* the ring is passed in the env, before rpc_*() replace it w/ the pid: */
+    Ring *r = (Ring *)Task_getEnv(Task_self());
+    RingMsg m;
+
+    DEBUG("ring task running: pid=%d", r->pid);
+
+    while (!r->stop) {
+        if (dce_ring_get(r->req, &m) == 0) {
+            rpc_VIDDEC3_process(sizeof(m.args), (UInt32 *)&m.args);
+            /* the client never has more than RING_NSLOTS requests in
+             * flight, so the response ring can't be full:
+             */
+            if (dce_ring_put(r->rsp, &m) > 0) {
+                Notify_sendEvent(hostId, 0, RING_EVENT, r->pid, FALSE);
+            }
+        } else if (dce_ring_sleep(r->req)) {
+            Semaphore_pend(r->doorbell, BIOS_WAIT_FOREVER);
+        }
+    }
+
+    DEBUG("ring task exiting: pid=%d", r->pid);
+
+    Semaphore_post(r->done);
+}
+
+/* take the client's rings out of the registry, to be freed by the caller
+ * with ring_free().  Returns NULL if there are none:
+ */
+static Ring * ring_unregister(Int pid)
+{
+    Client *c, *dead = NULL;
+    Ring *r = NULL;
+    UInt key = Task_disable();
+
+    c = get_client(pid);
+    if (c && c->ring) {
+        r = c->ring;
+        c->ring = NULL;
+        dead = put_client(c);
+    }
+
+    Task_restore(key);
+
+    free(dead);
+
+    return r;
+}
+
+/* stop the ring task, once unregistered so no more doorbells arrive: */
+static void ring_free(Ring *r)
+{
+    if (r->task) {
+        r->stop = TRUE;
+        Semaphore_post(r->doorbell);
+        Semaphore_pend(r->done, BIOS_WAIT_FOREVER);
+        Task_delete(&r->task);
+    }
+    Semaphore_delete(&r->doorbell);
+    Semaphore_delete(&r->done);
+    free(r);
+}
+
+RPC_SERVER(dce_ring_attach)
+{
+    Ptr rings = SharedRegion_getPtr((SharedRegion_SRPtr)args->in.rings);
+    Client *c, *nc = calloc(1, sizeof(*nc));
+    Ring *r = calloc(1, sizeof(*r));
+    Task_Params params;
+    Bool attached = FALSE;
+    UInt key;
+
+    DEBUG(">> pid=%d, rings=%08x (%p)", args->in.pid, args->in.rings, rings);
+
+    if (!r || !nc || !rings) {
+        ERROR("cannot attach rings");
+        goto out;
+    }
+
+    r->pid = args->in.pid;
+    r->req = REQ_RING(rings);
+    r->rsp = RSP_RING(rings);
+    r->stop = FALSE;
+    r->doorbell = Semaphore_create(0, NULL, NULL);
+    r->done = Semaphore_create(0, NULL, NULL);
+
+    if (!r->doorbell || !r->done) {
+        ERROR("cannot attach rings");
+        goto out;
+    }
+
+    Task_Params_init(&params);
+    params.env = r;
+    params.instance->name = "dce_ring";
+    r->task = Task_create(ring_task, &params, NULL);
+
+    if (!r->task) {
+        ERROR("cannot create ring task");
+        goto out;
+    }
+
+    /* the rings are usually attached before the client opens an engine,
+     * so this may be the first the registry hears of it.  A client only
+     * ever has the one pair of rings:
+     */
+    key = Task_disable();
+
+    c = get_client(r->pid);
+    if (!c) {
+        c = nc;
+        nc = NULL;
+        c->pid = r->pid;
+        c->hnext = clients[c->pid & (CLIENT_HASH - 1)];
+        clients[c->pid & (CLIENT_HASH - 1)] = c;
+    }
+
+    if (!c->ring) {
+        c->ring = r;
+        c->refs++;
+        attached = TRUE;
+    }
+
+    Task_restore(key);
+
+    if (!attached) {
+        ERROR("rings already attached: pid=%d", r->pid);
+        goto out;
+    }
+
+out:
+    /* out overlays in, so only once done with the args: */
+    args->out.ret = attached ? 0 : -1;
+
+    if (r && !attached) {
+        ring_free(r);
+    }
+    free(nc);
+
+    DEBUG("<< ret=%d", args->out.ret);
+}
+
+RPC_SERVER(dce_ring_detach)
+{
+    Ring *r = ring_unregister(args->in.pid);
+
+    DEBUG(">> pid=%d, r=%p", args->in.pid, r);
+
+    if (r) {
+        ring_free(r);
+    }
+
+    DEBUG("<<");
+}
+
+static Int ring_setup(void)
+{
+    hostId = MultiProc_getId("MPU");
+    return Notify_registerEvent(hostId, 0, RING_EVENT, ring_notify, 0);
+}
+
+static Void ring_teardown(void)
+{
+    Notify_unregisterEvent(hostId, 0, RING_EVENT, ring_notify, 0);
+}
+#else
+static struct {
+    Bool             enabled;
+    UInt16           procId;
+    IHeap_Handle     heap;
+    Ptr              rings;
+    pthread_mutex_t  req_mutex;   /* serializes producers */
+    pthread_mutex_t  rsp_mutex;   /* serializes consumers */
+    pthread_cond_t   rsp_cond;
+    sem_t            free;        /* free request slots */
+    Uint32           busy;        /* bitmask of results[] in use */
+    struct {
+        Bool         done;
+        XDAS_Int32   ret;
+    } results[RING_NSLOTS];       /* indexed by the request's seq */
+} ring = {
+        .req_mutex = PTHREAD_MUTEX_INITIALIZER,
+        .rsp_mutex = PTHREAD_MUTEX_INITIALIZER,
+        .rsp_cond  = PTHREAD_COND_INITIALIZER,
+};
+
+/* doorbell from ducati */
+static Void ring_notify(UInt16 procId, UInt16 lineId,
+        UInt32 eventId, UArg arg, UInt32 payload)
+{
+    pthread_mutex_lock(&ring.rsp_mutex);
+    pthread_cond_broadcast(&ring.rsp_cond);
+    pthread_mutex_unlock(&ring.rsp_mutex);
+}
+
+static XDAS_Int32 ring_process(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    DceRing *req = REQ_RING(ring.rings);
+    DceRing *rsp = RSP_RING(ring.rings);
+    XDAS_Int32 ret;
+    RingMsg m;
+    Uint32 idx;
+    int doorbell;
+
+    m.args.in.pid = pid;
+    process_args(&m.args, codec, inBufs, outBufs, inArgs, outArgs);
+    rpc_translate(&VIDDEC3_process__desc, &m.args);
+
+    /* this bounds the number of requests in flight, so the request ring
+     * can't be full and there is a free results[] slot.  A slot is only
+     * freed once it's owner has read the result, so a response can't land
+     * in a slot which a newer request has taken over:
+     */
+    sem_wait(&ring.free);
+
+    pthread_mutex_lock(&ring.rsp_mutex);
+    for (idx = 0; ring.busy & (1 << idx); idx++)
+        ;
+    ring.busy |= (1 << idx);
+    ring.results[idx].done = FALSE;
+    pthread_mutex_unlock(&ring.rsp_mutex);
+
+    m.seq = idx;
+
+    pthread_mutex_lock(&ring.req_mutex);
+    doorbell = dce_ring_put(req, &m);
+    pthread_mutex_unlock(&ring.req_mutex);
+
+    if (doorbell > 0) {
+        Notify_sendEvent(ring.procId, 0, RING_EVENT, pid, FALSE);
+    }
+
+    /* whoever holds rsp_mutex drains responses on behalf of all waiters: */
+    pthread_mutex_lock(&ring.rsp_mutex);
+    while (!ring.results[idx].done) {
+        RingMsg r;
+        if (dce_ring_get(rsp, &r) == 0) {
+            if ((r.seq < RING_NSLOTS) && (ring.busy & (1 << r.seq))) {
+                ring.results[r.seq].ret  = r.args.out.ret;
+                ring.results[r.seq].done = TRUE;
+            } else {
+                ERROR("stray response: seq=%u", r.seq);
+            }
+            pthread_cond_broadcast(&ring.rsp_cond);
+        } else if (dce_ring_sleep(rsp)) {
+            pthread_cond_wait(&ring.rsp_cond, &ring.rsp_mutex);
+        }
+    }
+    ret = ring.results[idx].ret;
+    ring.busy &= ~(1 << idx);
+    pthread_mutex_unlock(&ring.rsp_mutex);
+
+    sem_post(&ring.free);
+
+    return ret;
+}
+
+static Bool ring_enabled(void)
+{
+    return ring.enabled;
+}
+
+static int ring_init(void)
+{
+    int err;
+    dce_ring_attach__args args = {{0}};
+
+    ring.procId = MultiProc_getId("AppM3");
+    ring.heap = (IHeap_Handle)SharedRegion_getHeap(RING_SRID);
+    ring.rings = Memory_alloc(ring.heap, 2 * RING_SIZE, DCE_RING_CACHELINE, NULL);
+    if (!ring.rings) {
+        ERROR("fail: could not allocate rings");
+        return -1;
+    }
+
+    dce_ring_init(REQ_RING(ring.rings), RING_NSLOTS, sizeof(RingMsg));
+    dce_ring_init(RSP_RING(ring.rings), RING_NSLOTS, sizeof(RingMsg));
+    sem_init(&ring.free, 0, RING_NSLOTS);
+
+    err = Notify_registerEvent(ring.procId, 0, RING_EVENT, ring_notify, 0);
+    if (err < 0) {
+        ERROR("fail: could not register event: %08x", err);
+        goto fail;
+    }
+
+    args.in.rings = SharedRegion_getSRPtr(ring.rings, RING_SRID);
+
+    err = rpc_call(&cache, &dce_ring_attach__desc, &args);
+    if ((err < 0) || (args.out.ret < 0)) {
+        ERROR("fail: could not attach rings: %08x", err);
+        goto fail;
+    }
+
+    ring.enabled = TRUE;
+
+    INFO("ring transport enabled");
+
+    return 0;
+
+fail:
+    Notify_unregisterEvent(ring.procId, 0, RING_EVENT, ring_notify, 0);
+    Memory_free(ring.heap, ring.rings, 2 * RING_SIZE);
+    ring.rings = NULL;
+    return -1;
+}
+
+static void ring_deinit(void)
+{
+    dce_ring_detach__args args = {{0}};
+
+    if (!ring.enabled) {
+        return;
+    }
+
+    ring.enabled = FALSE;
+
+    rpc_call(&cache, &dce_ring_detach__desc, &args);
+
+    Notify_unregisterEvent(ring.procId, 0, RING_EVENT, ring_notify, 0);
+    Memory_free(ring.heap, ring.rings, 2 * RING_SIZE);
+    ring.rings = NULL;
+    sem_destroy(&ring.free);
+}
+#endif
+
+/*
+ * RCM transport.. the normal client side transport, RcmClient over syslink
+ * to the RcmServer on ducati.  See dce_transport.h.
+ */
+
+#if !defined(SERVER) && !defined(LOOPBACK)
+static RcmClient_Handle handle = NULL;
+
+static int rcm_create(String server)
+{
+    int err;
+    Ipc_Config config = {0};
+    RcmClient_Params params = {0};
+
+    Ipc_getConfig(&config);
+
+    err = Ipc_setup(&config);
+    DEBUG("Ipc_setup() -> %08x", err);
+
+    RcmClient_init();
+    RcmClient_Params_init(&params);
+    params.heapId = 1; //XXX do I need this?
+
+    return RcmClient_create(server, &params, &handle);
+}
+
+static int rcm_destroy(void)
+{
+    int err = 0;
+
+    if (handle) {
+        err = RcmClient_delete(&handle);
+        handle = NULL;
+    }
+
+    RcmClient_exit();
+
+    DEBUG("Ipc_destroy() -> %08x", Ipc_destroy());
+
+    return err;
+}
+
+static int rcm_get_symbol(String name, UInt32 *idx)
+{
+    return RcmClient_getSymbolIndex(handle, name, idx);
+}
+
+static int rcm_alloc(UInt32 sz, RcmClient_Message **msg)
+{
+    return RcmClient_alloc(handle, sz, msg);
+}
+
+static void rcm_free(RcmClient_Message *msg)
+{
+    RcmClient_free(handle, msg);
+}
+
+static int rcm_exec(RcmClient_Message *msg, RcmClient_Message **ret)
+{
+    return RcmClient_exec(handle, msg, ret);
+}
+
+static int rcm_exec_nowait(RcmClient_Message *msg, UInt16 *msgId)
+{
+    return RcmClient_execNoWait(handle, msg, msgId);
+}
+
+static int rcm_wait(UInt16 msgId, RcmClient_Message **ret)
+{
+    return RcmClient_waitUntilDone(handle, msgId, ret);
+}
+
+static const Transport rcm_transport = {
+        .name        = "rcm",
+        .create      = rcm_create,
+        .destroy     = rcm_destroy,
+        .get_symbol  = rcm_get_symbol,
+        .alloc       = rcm_alloc,
+        .free        = rcm_free,
+        .exec        = rcm_exec,
+        .exec_nowait = rcm_exec_nowait,
+        .wait        = rcm_wait,
+};
+#endif
+
+/*
+ * dce_get_symbols.. returns the indices of all the remote functions in one
+ * go, rather than one RcmClient_getSymbolIndex() round trip per function at
+ * startup.  If the server doesn't know this call, the client falls back to
+ * looking up the functions one at a time.
+ */
+
+#define RPC_MAXSYMS  24
+
+typedef union {
+    struct {
+        Int        pid;
+    } in;
+    struct {
+        Int32      n;
+        struct {
+            Char   name[24];
+            UInt32 idx;
+        } syms[RPC_MAXSYMS];
+    } out;
+} dce_get_symbols__args;
+
+RPC_DESC(dce_get_symbols, 0);
+
+#ifdef SERVER
+static RpcDesc *symbols[RPC_MAXSYMS];
+static Int nsymbols = 0;
+
+RPC_SERVER(dce_get_symbols)
+{
+    Int i;
+
+    for (i = 0; i < nsymbols; i++) {
+        strncpy(args->out.syms[i].name, symbols[i]->name,
+                DIM(args->out.syms[i].name) - 1);
+        args->out.syms[i].name[DIM(args->out.syms[i].name) - 1] = '\0';
+        args->out.syms[i].idx = symbols[i]->idx;
+    }
+    args->out.n = nsymbols;
+
+    DEBUG("<< n=%d", args->out.n);
+}
+#else
+static dce_get_symbols__args *symtab = NULL;
+
+static dce_get_symbols__args * get_symbols(void)
+{
+    dce_get_symbols__args *args;
+
+    if (transport->get_symbol(dce_get_symbols__desc.name,
+            &dce_get_symbols__desc.idx) < 0) {
+        INFO("no bulk symbol lookup, falling back to per function lookup");
+        return NULL;
+    }
+
+    args = calloc(1, sizeof(*args));
+    if (args && (rpc_call(&cache, &dce_get_symbols__desc, args) < 0)) {
+        free(args);
+        args = NULL;
+    }
+
+    return args;
+}
+
+/* find remote function index, from the bulk symbol table if we have it */
+static int rpc_resolve(RpcDesc *d)
+{
+    if (symtab) {
+        int i;
+        for (i = 0; i < MIN(symtab->out.n, RPC_MAXSYMS); i++) {
+            if (!strncmp(symtab->out.syms[i].name, d->name,
+                    DIM(symtab->out.syms[i].name))) {
+                d->idx = symtab->out.syms[i].idx;
+                return 0;
+            }
+        }
+    }
+
+    return transport->get_symbol(d->name, &d->idx);
+}
+#endif
+
+/*
+ * Output frame pool.. tracks which output frames are free, held by the
+ * codec (as reference frames, or until displayed), and held by the user
+ * (ie. display and/or encoder).  Each frame has a reference count, the
+ * codec holds one reference from dce_frame_get() until the frame shows
+ * up in outArgs->freeBufID[], and the user gets a reference for each
+ * frame in outArgs->outputID[] from dce_frame_pool_update().
+ *
+ * Frames are released to the pool lock-free, so any thread can drop it's
+ * reference.  Released frames are pushed on a stack with compare-and-swap,
+ * and dce_frame_get() takes the whole stack at once, with an atomic swap,
+ * so there is no ABA problem.  dce_frame_get() and dce_frame_pool_update()
+ * must only be called from the decoding thread.
+ */
+
+#ifndef SERVER
+typedef struct Frame Frame;
+
+struct Frame {
+    struct dce_frame f;           /* must be first */
+    int    ref;
+    Frame *next;                  /* in free list */
+    struct dce_frame_pool *pool;
+};
+
+struct dce_frame_pool {
+    Frame  *free;                 /* only touched by the decoding thread */
+    Frame  *released;             /* lock-free stack of released frames */
+    Frame  *inuse;                /* frame to pass to the codec again */
+    Frame  *last;                 /* last frame passed to the codec */
+    int     nframes, max;
+    Frame **frames;               /* indexed by id - 1 */
+};
+
+/**
+ * Create a pool for up to max frames, which are added with
+ * dce_frame_pool_add().
+ */
+struct dce_frame_pool * dce_frame_pool_create(int max)
+{
+    struct dce_frame_pool *pool = calloc(1, sizeof(*pool));
+
+    if (!pool) {
+        return NULL;
+    }
+
+    pool->frames = calloc(max, sizeof(pool->frames[0]));
+    if (!pool->frames) {
+        free(pool);
+        return NULL;
+    }
+
+    pool->max = max;
+
+    return pool;
+}
+
+/**
+ * Delete a pool, and all it's frames.  The caller is responsible for
+ * freeing the buffers, and no frames may still be in use.
+ */
+void dce_frame_pool_delete(struct dce_frame_pool *pool)
+{
+    int i;
+
+    for (i = 0; i < pool->nframes; i++) {
+        free(pool->frames[i]);
+    }
+
+    free(pool->frames);
+    free(pool);
+}
+
+/**
+ * Add a frame to the pool.  The y and uv addresses are what should be
+ * passed to the codec in outBufs, and priv is for the caller.
+ */
+struct dce_frame * dce_frame_pool_add(struct dce_frame_pool *pool,
+        XDAS_Int8 *y, XDAS_Int8 *uv, void *priv)
+{
+    Frame *frame;
+
+    if (pool->nframes == pool->max) {
+        ERROR("fail: pool full");
+        return NULL;
+    }
+
+    frame = calloc(1, sizeof(*frame));
+    if (!frame) {
+        return NULL;
+    }
+
+    frame->f.y    = y;
+    frame->f.uv   = uv;
+    frame->f.priv = priv;
+    frame->f.id   = ++pool->nframes;
+    frame->pool   = pool;
+
+    pool->frames[frame->f.id - 1] = frame;
+
+    frame->next = pool->free;
+    pool->free  = frame;
+
+    return &frame->f;
+}
+
+/**
+ * Get a frame to pass to the codec in outBufs, with frame->id as the
+ * inArgs->inputID.  If the codec still needs the frame passed in the
+ * last call (outArgs->outBufsInUseFlag), that is returned again.
+ * Returns NULL if no frame is free.
+ */
+struct dce_frame * dce_frame_get(struct dce_frame_pool *pool)
+{
+    Frame *frame = pool->inuse;
+
+    if (frame) {
+        return &frame->f;
+    }
+
+    if (!pool->free) {
+        pool->free = __sync_lock_test_and_set(&pool->released, NULL);
+    }
+
+    frame = pool->free;
+    if (!frame) {
+        return NULL;
+    }
+
+    pool->free = frame->next;
+    frame->ref = 1;               /* held by the codec */
+    pool->last = frame;
+
+    return &frame->f;
+}
+
+void dce_frame_ref(struct dce_frame *f)
+{
+    __sync_add_and_fetch(&((Frame *)f)->ref, 1);
+}
+
+/**
+ * Drop a reference to a frame, from any thread.  When the last reference
+ * is dropped, the frame is returned to the pool.
+ */
+void dce_frame_unref(struct dce_frame *f)
+{
+    Frame *frame = (Frame *)f;
+    struct dce_frame_pool *pool = frame->pool;
+    Frame *head;
+
+    if (__sync_sub_and_fetch(&frame->ref, 1)) {
+        return;
+    }
+
+    do {
+        head = pool->released;
+        frame->next = head;
+    } while (!__sync_bool_compare_and_swap(&pool->released, head, frame));
+}
+
+static Frame * id2frame(struct dce_frame_pool *pool, XDAS_Int32 id)
+{
+    if ((id < 1) || (id > pool->nframes)) {
+        ERROR("invalid frame id: %d", id);
+        return NULL;
+    }
+    return pool->frames[id - 1];
+}
+
+/**
+ * Update the pool after VIDDEC3_process(): the frames to display are
+ * returned in display[], with a reference for the caller, and the frames
+ * the codec is done with are released.  Returns the number of frames in
+ * display[].
+ */
+int dce_frame_pool_update(struct dce_frame_pool *pool,
+        VIDDEC3_OutArgs *outArgs, struct dce_frame **display, int max)
+{
+    int i, n = 0;
+
+    for (i = 0; (i < DIM(outArgs->outputID)) && outArgs->outputID[i]; i++) {
+        Frame *frame = id2frame(pool, outArgs->outputID[i]);
+        if (frame && (n < max)) {
+            dce_frame_ref(&frame->f);
+            display[n++] = &frame->f;
+        }
+    }
+
+    for (i = 0; (i < DIM(outArgs->freeBufID)) && outArgs->freeBufID[i]; i++) {
+        Frame *frame = id2frame(pool, outArgs->freeBufID[i]);
+        if (frame) {
+            dce_frame_unref(&frame->f);
+        }
+    }
+
+    /* the codec didn't consume the frame, so pass it again next time: */
+    pool->inuse = outArgs->outBufsInUseFlag ? pool->last : NULL;
+
+    return n;
+}
+#endif
+
+/*
+ * Output buffer cache.. allocating a set of 2D output buffers means a
+ * MemMgr_Alloc() per buffer, which is slow, and freeing them at the end of
+ * each stream only to allocate the same again for the next one is a waste.
+ * So sets of buffers that are put back with dce_buffers_put() are kept,
+ * keyed by their dimensions, for the next dce_buffers_get().  The least
+ * recently used sets are freed when the cache goes over budget.
+ *
+ * Each MemMgr_Alloc() allocates several buffers at once, for 2D buffers
+ * two (four blocks, each with a Y and UV block), for 1D buffers four.
+ */
+
+#ifndef SERVER
+#define BUFSET_BATCH_2D 2         /* buffers per MemMgr_Alloc(), 2D */
+#define BUFSET_BATCH_1D 4         /* buffers per MemMgr_Alloc(), 1D */
+#define BUFSET_BUDGET   (32 * 1024 * 1024)
+
+typedef struct BufSet BufSet;
+
+struct BufSet {
+    struct dce_buffers b;         /* must be first */
+    void   *allocs[DCE_MAX_BUFFERS];
+    int     nallocs;
+    UInt32  bytes;
+    BufSet *next;                 /* in cache, most recently used first */
+};
+
+static pthread_mutex_t bufset_mutex = PTHREAD_MUTEX_INITIALIZER;
+static BufSet *bufsets = NULL;
+static UInt32 bufset_bytes = 0;   /* total size of cached sets */
+static UInt32 bufset_budget = BUFSET_BUDGET;
+
+/* size of the host mapping of one buffer: */
+static UInt32 bufset_bufsz(struct dce_buffers *b)
+{
+    if (b->stride == DCE_TILER_STRIDE) {
+        return (b->height + (b->height / 2)) * DCE_TILER_STRIDE;
+    }
+    return ALIGN((b->height + (b->height / 2)) * b->stride, BUF_PAGE);
+}
+
+/* allocate n buffers of the set in one go */
+static char * bufset_alloc_batch(BufSet *s, int n)
+{
+    struct dce_buffers *b = &s->b;
+#ifdef LOOPBACK
+    DucatiAddr ducati_addr;
+    return page_alloc(n * bufset_bufsz(b), &ducati_addr);
+#else
+    MemAllocBlock block[2 * BUFSET_BATCH_2D] = {{0}};
+    int j, nblocks = 0;
+    char *p;
+
+    for (j = 0; j < n; j++) {
+        if (b->stride == DCE_TILER_STRIDE) {
+            block[nblocks].pixelFormat = PIXEL_FMT_8BIT;
+            block[nblocks].dim.area.width  = b->width;
+            block[nblocks].dim.area.height = b->height;
+            nblocks++;
+            block[nblocks].pixelFormat = PIXEL_FMT_16BIT;
+            block[nblocks].dim.area.width  = b->width;
+            block[nblocks].dim.area.height = b->height / 2;
+            nblocks++;
+        } else {
+            block[nblocks].pixelFormat = PIXEL_FMT_PAGE;
+            block[nblocks].dim.len = (b->height + (b->height / 2)) * b->stride;
+            nblocks++;
+        }
+    }
+
+    p = MemMgr_Alloc(block, nblocks);
+    if (p) {
+        __sync_add_and_fetch(&tiler_bytes, n * bufset_bufsz(b));
+    }
+
+    return p;
+#endif
+}
+
+/* buffers per bufset_alloc_batch() */
+static int bufset_batch(struct dce_buffers *b)
+{
+    return (b->stride == DCE_TILER_STRIDE) ? BUFSET_BATCH_2D : BUFSET_BATCH_1D;
+}
+
+static void bufset_free(BufSet *s)
+{
+    struct dce_buffers *b = &s->b;
+
+    while (s->nallocs) {
+        int i = --s->nallocs * bufset_batch(b);
+        page_free(s->allocs[s->nallocs],
+                MIN(b->cnt - i, bufset_batch(b)) * bufset_bufsz(b));
+    }
+    free(s);
+}
+
+static BufSet * bufset_new(int cnt, int width, int height, int stride)
+{
+    BufSet *s = calloc(1, sizeof(*s));
+    struct dce_buffers *b;
+    int i, n;
+
+    if (!s) {
+        return NULL;
+    }
+
+    b = &s->b;
+    b->cnt    = cnt;
+    b->width  = width;
+    b->height = height;
+    b->stride = stride;
+
+    s->bytes = cnt * bufset_bufsz(b);
+
+    for (i = 0; i < cnt; i += n) {
+        char *p;
+        int j;
+
+        n = MIN(cnt - i, bufset_batch(b));
+
+        p = bufset_alloc_batch(s, n);
+        if (!p) {
+            ERROR("fail: could not allocate %dx%d buffers", width, height);
+            bufset_free(s);
+            return NULL;
+        }
+
+        s->allocs[s->nallocs++] = p;
+
+        for (j = 0; j < n; j++) {
+            struct dce_buffer *buf = &b->bufs[i + j];
+            buf->buf = p + (j * bufset_bufsz(b));
+            buf->y   = (XDAS_Int8 *)page2ducati(buf->buf);
+            buf->uv  = (XDAS_Int8 *)page2ducati(buf->buf + (height * stride));
+        }
+    }
+
+    return s;
+}
+
+/* free least recently used sets until under budget, called with
+ * bufset_mutex held
+ */
+static void bufset_trim(void)
+{
+    while (bufset_bytes > bufset_budget) {
+        BufSet **p = &bufsets, *s;
+
+        while ((*p)->next) {
+            p = &(*p)->next;
+        }
+
+        s = *p;
+        *p = NULL;
+        bufset_bytes -= s->bytes;
+
+        DEBUG("evict %dx%d (%d)", s->b.width, s->b.height, s->b.cnt);
+        bufset_free(s);
+    }
+}
+
+/**
+ * Get a set of cnt (up to DCE_MAX_BUFFERS) NV12 output buffers, for the
+ * specified padded width/height.  With a stride of DCE_TILER_STRIDE the
+ * buffers are 2D, otherwise 1D with the specified stride.  If a set with
+ * the same dimensions and at least cnt buffers was put back in the cache
+ * it is reused, otherwise a new set is allocated.
+ */
+struct dce_buffers * dce_buffers_get(int cnt, int width, int height,
+        int stride)
+{
+    BufSet **p, *s = NULL;
+
+    if ((cnt < 1) || (cnt > DCE_MAX_BUFFERS)) {
+        ERROR("fail: invalid count: %d", cnt);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&bufset_mutex);
+    for (p = &bufsets; *p; p = &(*p)->next) {
+        struct dce_buffers *b = &(*p)->b;
+        if ((b->width == width) && (b->height == height) &&
+                (b->stride == stride) && (b->cnt >= cnt)) {
+            s = *p;
+            *p = s->next;
+            bufset_bytes -= s->bytes;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&bufset_mutex);
+
+    if (s) {
+        DEBUG("reuse %dx%d (%d)", width, height, s->b.cnt);
+        return &s->b;
+    }
+
+    s = bufset_new(cnt, width, height, stride);
+
+    return s ? &s->b : NULL;
+}
+
+/**
+ * Put a set of buffers back in the cache, once the codec and display are
+ * done with all of them.
+ */
+void dce_buffers_put(struct dce_buffers *b)
+{
+    BufSet *s = (BufSet *)b;
+
+    pthread_mutex_lock(&bufset_mutex);
+    s->next = bufsets;
+    bufsets = s;
+    bufset_bytes += s->bytes;
+    bufset_trim();
+    pthread_mutex_unlock(&bufset_mutex);
+}
+
+/**
+ * Set the max size, in bytes, of cached buffer sets.  A budget of zero
+ * disables caching, and frees all cached sets.
+ */
+void dce_buffers_set_budget(unsigned int budget)
+{
+    pthread_mutex_lock(&bufset_mutex);
+    bufset_budget = budget;
+    bufset_trim();
+    pthread_mutex_unlock(&bufset_mutex);
+}
+#endif
+
+/*
+ * dce_get_mem_stats
+ */
+
+typedef union {
+    struct {
+        Int        pid;
+        DucatiAddr codec;
     } in;
     struct {
-        Uint32 codec;
+        struct dce_mem_stats stats;
     } out;
-} VIDDEC3_create__args;
+} dce_get_mem_stats__args;
+
+RPC_DESC_HANDLE(dce_get_mem_stats,
+        RPC_CODEC(dce_get_mem_stats, in.codec), 0);
 
 #ifdef SERVER
-static Int32 rpc_VIDDEC3_create(UInt32 size, UInt32 *data)
+RPC_SERVER(dce_get_mem_stats)
 {
-    VIDDEC3_create__args *args = (VIDDEC3_create__args *)data;
-    VIDDEC3_Params *params = (VIDDEC3_Params *)args->in.params;
-    Int pid = args->in.pid;
+    struct dce_mem_stats stats = {{{0}}};
+    VIDDEC3_Handle codec = (VIDDEC3_Handle)args->in.codec;
+    Client *c;
+    ClientCodec *cc;
+    Memory_Stats s;
+    UInt key;
+
+    Memory_getStats(heap0, &s);
+    stats.heap[0].size      = s.totalSize;
+    stats.heap[0].used      = s.totalSize - s.totalFreeSize;
+    stats.heap[0].max_block = s.largestFreeSize;
+
+    heapvideo_stats(&stats.heap[1]);
+
+    key = Task_disable();
+    memcpy(stats.total, mem_total, sizeof(stats.total));
+    memcpy(stats.peak, mem_peak, sizeof(stats.peak));
+    memcpy(stats.allocs, mem_allocs, sizeof(stats.allocs));
+    memcpy(stats.failed, mem_failed, sizeof(stats.failed));
+    c = get_client(args->in.pid);
+    if (c) {
+        memcpy(stats.client, c->mem, sizeof(stats.client));
+    }
+    cc = codec ? get_codec(args->in.pid, codec) : NULL;
+    if (cc) {
+        memcpy(stats.codec, cc->mem, sizeof(stats.codec));
+    }
+    Task_restore(key);
+
+    args->out.stats = stats;
+}
+#else
+/**
+ * Get memory usage of the heaps on ducati, and what of it is used by this
+ * process, and by the specified codec (which can be NULL).  The per codec
+ * figures are what the codec allocated while being created, which is most
+ * of what it will ever use.  Requires an open engine.
+ */
+int dce_get_mem_stats(VIDDEC3_Handle codec, struct dce_mem_stats *stats)
+{
+    dce_get_mem_stats__args args = {{0}};
 
-    DEBUG(">> engine=%08x, name=%s, params=%p", args->in.engine, args->in.name, params);
-    Task_setEnv(Task_self(), (Ptr) args->in.pid);
-    args->out.codec = (Uint32)
-            VIDDEC3_create((Engine_Handle)args->in.engine, args->in.name, params);
-    dce_clean (params);
-    DEBUG("<< codec=%08x", args->out.codec);
+    args.in.codec = codec ? codec2ducati(codec) : 0;
 
-    if (args->out.codec) {
-        dce_register_codec(pid, (VIDDEC3_Handle)(args->out.codec));
+    if (rpc_call(&cache, &dce_get_mem_stats__desc, &args) < 0) {
+        return -1;
     }
 
+    *stats = args.out.stats;
+    stats->host_tiler = tiler_bytes;
+
+    pthread_mutex_lock(&bufset_mutex);
+    stats->host_cached = bufset_bytes;
+    pthread_mutex_unlock(&bufset_mutex);
+
     return 0;
 }
-#else
-static UInt32 idx_VIDDEC3_create;
-VIDDEC3_Handle VIDDEC3_create(Engine_Handle engine, String name,
-        VIDDEC3_Params *params)
+
+/* CE's memory statistics API, in terms of dce_get_mem_stats().  Ducati has
+ * two memory segments, heap0 and heap1 (heapvideo):
+ */
+
+Server_Handle Engine_getServer(Engine_Handle engine)
 {
-    int err;
-    VIDDEC3_Handle ret;
-    VIDDEC3_create__args *args;
-    RcmClient_Message *msg = NULL;
+    return (Server_Handle)engine;
+}
 
-    DEBUG(">> engine=%p, name=%s, params=%p", engine, name, params);
+Engine_Error Engine_getNumMemSegs(Server_Handle server, Int *numSegs)
+{
+    *numSegs = 2;
+    return Engine_EOK;
+}
 
-    err = RcmClient_alloc(handle, sizeof(VIDDEC3_create__args), &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
-    }
+Engine_Error Engine_getMemStat(Server_Handle server, Int segNum,
+        Engine_MemStat *stat)
+{
+    static const String names[] = { "heap0", "heapvideo" };
+    struct dce_mem_stats stats;
 
-    msg->fxnIdx = idx_VIDDEC3_create;
-    args = (VIDDEC3_create__args *)&(msg->data);
-    args->in.pid    = pid;
-    args->in.engine = (Uint32)engine;
-    strncpy(args->in.name, name, DIM(args->in.name)-1);
-    args->in.params = virt2ducati(params);
+    if ((segNum < 0) || (segNum >= DIM(names))) {
+        return Engine_EINVAL;
+    }
 
-    err = RcmClient_exec(handle, msg, &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
+    if (dce_get_mem_stats(NULL, &stats) < 0) {
+        return Engine_ERUNTIME;
     }
 
-    args = (VIDDEC3_create__args *)&(msg->data);
-    ret = (VIDDEC3_Handle)args->out.codec;
+    memset(stat, 0, sizeof(*stat));
+    strncpy(stat->name, names[segNum], Engine_MAXSEGNAMELENGTH);
+    stat->size        = stats.heap[segNum].size;
+    stat->used        = stats.heap[segNum].used;
+    stat->maxBlockLen = stats.heap[segNum].max_block;
 
-    DEBUG("<< codec=%p", ret);
+    return Engine_EOK;
+}
 
-out:
-    if (msg) {
-        RcmClient_free (handle, msg);
+UInt32 Engine_getUsedMem(Engine_Handle engine)
+{
+    struct dce_mem_stats stats;
+
+    if (dce_get_mem_stats(NULL, &stats) < 0) {
+        return 0;
     }
 
-    return ret;
+    return stats.heap[0].used + stats.heap[1].used;
 }
 #endif
 
 /*
- * VIDDEC3_control
+ * dce_set_mem_walk.. for benchmarks, to compare with how the memory usage
+ * used to be tracked, see dce_mem_walk.
  */
 
 typedef union {
     struct {
-        Int             pid;
-        Uint32          codec;
-        VIDDEC3_Cmd     id;
-        Uint32          dynParams;
-        Uint32          status;
+        Int        pid;
+        Int32      on;
     } in;
     struct {
-        XDAS_Int32      ret;
+        Int32      ret;
     } out;
-} VIDDEC3_control__args;
+} dce_set_mem_walk__args;
+
+RPC_DESC(dce_set_mem_walk, 0);
 
 #ifdef SERVER
-static Int32 rpc_VIDDEC3_control(UInt32 size, UInt32 *data)
+RPC_SERVER(dce_set_mem_walk)
 {
-    VIDDEC3_control__args *args = (VIDDEC3_control__args *)data;
-    VIDDEC3_DynamicParams *dynParams =
-            (VIDDEC3_DynamicParams *)args->in.dynParams;
-    VIDDEC3_Status *status = (VIDDEC3_Status *)args->in.status;
-
-    DEBUG(">> codec=%p, id=%d, dynParams=%p, status=%p",
-            args->in.codec, args->in.id, dynParams, status);
-    Task_setEnv(Task_self(), (Ptr) args->in.pid);
-    args->out.ret = (Uint32)VIDDEC3_control(
-            (VIDDEC3_Handle)args->in.codec, args->in.id, dynParams, status);
-    dce_clean (dynParams);
-    dce_clean (status);
-    DEBUG("<< ret=%d", args->out.ret);
+    Int32 on = args->in.on;
 
-    return 0;
+    args->out.ret = dce_mem_walk;
+    dce_mem_walk = !!on;
 }
 #else
-static UInt32 idx_VIDDEC3_control;
-XDAS_Int32 VIDDEC3_control(VIDDEC3_Handle codec, VIDDEC3_Cmd id,
-        VIDDEC3_DynamicParams *dynParams, VIDDEC3_Status *status)
+/**
+ * Make ducati walk the heaps with Memory_getStats() on every memTab
+ * alloc/free and around VIDDEC3_create(), and log the result, as it used
+ * to before the usage was counted.  This is slow, it is only there so
+ * benchmarks can compare.  Returns the previous setting, or -1 on error.
+ */
+int dce_set_mem_walk(int on)
 {
-    int err;
-    XDAS_Int32 ret;
-    VIDDEC3_control__args *args;
-    RcmClient_Message *msg = NULL;
-
-    DEBUG(">> codec=%p, id=%d, dynParams=%p, status=%p",
-            codec, id, dynParams, status);
-
-    err = RcmClient_alloc(handle, sizeof(VIDDEC3_control__args), &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
-    }
-
-    msg->fxnIdx = idx_VIDDEC3_control;
-    args = (VIDDEC3_control__args *)&(msg->data);
-    args->in.pid        = pid;
-    args->in.codec      = (Uint32)codec;
-    args->in.id         = id;
-    args->in.dynParams  = virt2ducati(dynParams);
-    args->in.status     = virt2ducati(status);
-
-    err = RcmClient_exec(handle, msg, &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
-    }
-
-    args = (VIDDEC3_control__args *)&(msg->data);
-    ret = args->out.ret;
+    dce_set_mem_walk__args args = {{0}};
 
-    DEBUG("<< ret=%d", ret);
+    args.in.on = on;
 
-out:
-    if (msg) {
-        RcmClient_free (handle, msg);
+    if (rpc_call(&cache, &dce_set_mem_walk__desc, &args) < 0) {
+        return -1;
     }
 
-    return ret;
+    return args.out.ret;
 }
 #endif
 
 /*
- * VIDDEC3_process
+ * dce_set_frame_period/dce_get_ivahd_stats.. the IVA-HD clock is managed
+ * by a governor in the platform code, which picks the OPP from the
+ * measured load.  Clients can help it along by saying how often they will
+ * be decoding frames, so it can see it will need to keep up before it has
+ * measured it.
  */
 
 typedef union {
     struct {
         Int        pid;
-        Uint32     codec;
-        Uint32     inBufs;
-        Uint32     outBufs;
-        Uint32     inArgs;
-        Uint32     outArgs;
+        DucatiAddr codec;
+        Int32      usecs;
     } in;
     struct {
-        XDAS_Int32 ret;
+        Int32      ret;
     } out;
-} VIDDEC3_process__args;
+} dce_set_frame_period__args;
+
+typedef union {
+    struct {
+        Int        pid;
+    } in;
+    struct {
+        struct dce_ivahd_stats stats;
+    } out;
+} dce_get_ivahd_stats__args;
+
+RPC_DESC_HANDLE(dce_set_frame_period,
+        RPC_CODEC(dce_set_frame_period, in.codec), 0);
+RPC_DESC(dce_get_ivahd_stats, 0);
 
 #ifdef SERVER
-static Int32 rpc_VIDDEC3_process(UInt32 size, UInt32 *data)
+RPC_SERVER(dce_set_frame_period)
 {
-    VIDDEC3_process__args *args = (VIDDEC3_process__args *)data;
-    XDM2_BufDesc    *inBufs  = (XDM2_BufDesc *)args->in.inBufs;
-    XDM2_BufDesc    *outBufs = (XDM2_BufDesc *)args->in.outBufs;
-    VIDDEC3_InArgs  *inArgs  = (VIDDEC3_InArgs *)args->in.inArgs;
-    VIDDEC3_OutArgs *outArgs = (VIDDEC3_OutArgs *)args->in.outArgs;
+    VIDDEC3_Handle codec = (VIDDEC3_Handle)args->in.codec;
+    Int32 usecs = args->in.usecs;
+    ClientCodec *cc;
+    UInt32 rate = 0;
+    UInt key;
+
+    key = Task_disable();
+    cc = codec ? get_codec(args->in.pid, codec) : NULL;
+    if (cc) {
+        rate_total -= cc->rate;
+        cc->rate = (usecs > 0) ? (1000000000 / usecs) : 0;
+        rate_total += cc->rate;
+        rate = rate_total;
+    }
+    Task_restore(key);
 
-    DEBUG(">> codec=%p, inBufs=%p, outBufs=%p, inArgs=%p, outArgs=%p",
-            args->in.codec, inBufs, outBufs, inArgs, outArgs);
-    Task_setEnv(Task_self(), (Ptr) args->in.pid);
-    ivahd_acquire();
-    args->out.ret = (Uint32)VIDDEC3_process(
-            (VIDDEC3_Handle)args->in.codec, inBufs, outBufs, inArgs, outArgs);
-    ivahd_release();
-    dce_clean (inBufs);
-    dce_clean (outBufs);
-    dce_clean (inArgs);
-    dce_clean (outArgs);
-    DEBUG("<< ret=%d", args->out.ret);
+    if (!cc) {
+        args->out.ret = -1;
+        return;
+    }
 
-    return 0;
+    DEBUG("codec=%p, usecs=%d, rate=%u", codec, usecs, rate);
+
+    ivahd_set_rate(rate);
+    args->out.ret = 0;
+}
+
+RPC_SERVER(dce_get_ivahd_stats)
+{
+    struct dce_ivahd_stats stats;
+    ivahd_get_stats(&stats);
+    args->out.stats = stats;
 }
 #else
-static UInt32 idx_VIDDEC3_process;
-XDAS_Int32 VIDDEC3_process(VIDDEC3_Handle codec,
-        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
-        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+/**
+ * Tell ducati the codec will be decoding a frame every 'usecs', or zero if
+ * that isn't known.  This is only a hint, for the IVA-HD clock governor.
+ */
+int dce_set_frame_period(VIDDEC3_Handle codec, int usecs)
 {
-    int err;
-    XDAS_Int32 ret;
-    VIDDEC3_process__args *args;
-    RcmClient_Message *msg = NULL;
-
-    DEBUG(">> codec=%p, inBufs=%p, outBufs=%p, inArgs=%p, outArgs=%p",
-            codec, inBufs, outBufs, inArgs, outArgs);
-
-    err = RcmClient_alloc(handle, sizeof(VIDDEC3_process__args), &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
-    }
+    dce_set_frame_period__args args = {{0}};
 
-    msg->fxnIdx = idx_VIDDEC3_process;
-    args = (VIDDEC3_process__args *)&(msg->data);
-    args->in.pid     = pid;
-    args->in.codec   = (Uint32)codec;
-    args->in.inBufs  = virt2ducati(inBufs);
-    args->in.outBufs = virt2ducati(outBufs);
-    args->in.inArgs  = virt2ducati(inArgs);
-    args->in.outArgs = virt2ducati(outArgs);
+    args.in.codec = codec2ducati(codec);
+    args.in.usecs = usecs;
 
-    err = RcmClient_exec(handle, msg, &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
+    if (rpc_call(&((Codec *)codec)->cache,
+            &dce_set_frame_period__desc, &args) < 0) {
+        return -1;
     }
 
-    args = (VIDDEC3_process__args *)&(msg->data);
-    ret = args->out.ret;
+    return args.out.ret;
+}
 
-    DEBUG("<< ret=%d", ret);
+/**
+ * Get what the IVA-HD clock governor on ducati is doing, and how long the
+ * IVA-HD has spent at each OPP.  Requires an open engine.
+ */
+int dce_get_ivahd_stats(struct dce_ivahd_stats *stats)
+{
+    dce_get_ivahd_stats__args args = {{0}};
 
-out:
-    if (msg) {
-        RcmClient_free (handle, msg);
+    if (rpc_call(&cache, &dce_get_ivahd_stats__desc, &args) < 0) {
+        return -1;
     }
 
-    return ret;
+    *stats = args.out.stats;
+
+    return 0;
 }
 #endif
 
 /*
- * VIDDEC3_delete
+ * dce_set_weight/dce_set_deadline.. when several codecs are decoding at
+ * once, they share the IVA-HD, see sched_enter().  Codecs with a deadline
+ * go first, the rest share what is left according to their weight.
  */
 
+#define DCE_MAX_WEIGHT 64
+
 typedef union {
     struct {
-        Int    pid;
-        Uint32 codec;
+        Int        pid;
+        DucatiAddr codec;
+        Int32      weight;
     } in;
-} VIDDEC3_delete__args;
+    struct {
+        Int32      ret;
+    } out;
+} dce_set_weight__args;
+
+RPC_DESC_HANDLE(dce_set_weight, RPC_CODEC(dce_set_weight, in.codec), 0);
 
 #ifdef SERVER
-static Int32 rpc_VIDDEC3_delete(UInt32 size, UInt32 *data)
+RPC_SERVER(dce_set_weight)
 {
-    VIDDEC3_delete__args *args = (VIDDEC3_delete__args *)data;
+    VIDDEC3_Handle codec = (VIDDEC3_Handle)args->in.codec;
+    Int32 weight = args->in.weight;
+    ClientCodec *cc;
+    UInt key;
+
+    if ((weight < 1) || (weight > DCE_MAX_WEIGHT)) {
+        ERROR("invalid weight: %d", weight);
+        args->out.ret = -1;
+        return;
+    }
 
-    dce_unregister_codec(args->in.pid, (VIDDEC3_Handle)(args->in.codec));
+    key = Task_disable();
+    cc = codec ? get_codec(args->in.pid, codec) : NULL;
+    if (cc) {
+        cc->weight = weight;
+    }
+    Task_restore(key);
 
-    DEBUG(">> codec=%08x", args->in.codec);
-    Task_setEnv(Task_self(), (Ptr) args->in.pid);
-    VIDDEC3_delete((VIDDEC3_Handle)(args->in.codec));
-    DEBUG("<<");
+    DEBUG("codec=%p, weight=%d", codec, weight);
 
-    return 0;
+    args->out.ret = cc ? 0 : -1;
 }
 #else
-static UInt32 idx_VIDDEC3_delete;
-Void VIDDEC3_delete(VIDDEC3_Handle codec)
+/**
+ * Set the codec's share of the IVA-HD, relative to the other codecs
+ * decoding at the same time, from 1 (default) to 64.
+ */
+int dce_set_weight(VIDDEC3_Handle codec, int weight)
 {
-    int err;
-    VIDDEC3_delete__args *args;
-    RcmClient_Message *msg = NULL;
-
-    DEBUG(">> codec=%p", codec);
-
-    err = RcmClient_alloc(handle, sizeof(VIDDEC3_delete__args), &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
-    }
+    dce_set_weight__args args = {{0}};
 
-    msg->fxnIdx = idx_VIDDEC3_delete;
-    args = (VIDDEC3_delete__args *)&(msg->data);
-    args->in.pid   = pid;
-    args->in.codec = (Uint32)codec;
+    args.in.codec  = codec2ducati(codec);
+    args.in.weight = weight;
 
-    err = RcmClient_exec(handle, msg, &msg);
-    if (err < 0) {
-        ERROR("fail: %08x", err);
-        goto out;
+    if (rpc_call(&((Codec *)codec)->cache,
+            &dce_set_weight__desc, &args) < 0) {
+        return -1;
     }
 
-    DEBUG("<<");
+    return args.out.ret;
+}
 
-out:
-    if (msg) {
-        RcmClient_free (handle, msg);
-    }
+/**
+ * Ask for the codec's subsequent VIDDEC3_process() calls to be done within
+ * 'usecs' of reaching ducati, or zero for no deadline (default).  Calls with
+ * a deadline get the IVA-HD ahead of those without, earliest deadline first.
+ */
+void dce_set_deadline(VIDDEC3_Handle codec, int usecs)
+{
+    ((Codec *)codec)->deadline = MAX(usecs, 0);
 }
 #endif
 
@@ -792,44 +4515,61 @@ out:
  * Startup/Shutdown/Cleanup
  */
 
-#ifdef SERVER
+#if defined(SERVER) && !defined(LOOPBACK)
 static void dce_cleanup_cb (slpm_eventType evt, UInt32 pid, int *err)
 {
     Client *c;
+    Ring *r;
+    UInt key;
 
     if (evt != slpm_PROC_OBIT) {
         return;
     }
 
-    // TODO should be synchronized, but re-entrant..
+    INFO("cleanup: pid=%d", pid);
 
-    c = get_client(pid);
-    INFO("cleanup: pid=%d, c=%p", pid, c);
+    /* stop the ring task first, so it can't race with deleting codecs */
+    r = ring_unregister(pid);
+    if (r) {
+        ring_free(r);
+    }
 
-    if (c) {
-        int i;
+    /* delete all codecs first, and lastly close all engines.  Each one is
+     * unregistered as it goes, and the client freed with the last, so it
+     * is looked up again each time:
+     */
+    while (TRUE) {
+        VIDDEC3_delete__args args;
 
-        /* delete all codecs first */
-        for (i = 0; i < DIM(c->codecs); i++) {
-            if (c->codecs[i]) {
-                VIDDEC3_delete__args args;
-                INFO("automatically deleting codec: %p", c->codecs[i]);
-                args.in.pid = pid;
-                args.in.codec = (Uint32)c->codecs[i];
-                rpc_VIDDEC3_delete(sizeof(args), (Uint32 *)&args);
-            }
+        key = Task_disable();
+        c = get_client(pid);
+        args.in.codec = (c && c->codecs) ? c->codecs->handle : 0;
+        Task_restore(key);
+
+        if (!args.in.codec) {
+            break;
         }
 
-        /* and lastly close all engines */
-        for (i = 0; i < DIM(c->engines); i++) {
-            if (c->engines[i]) {
-                Engine_close__args args;
-                INFO("automatically closing engine: %p", c->engines[i]);
-                args.in.pid = pid;
-                args.in.engine = (Uint32)c->engines[i];
-                rpc_Engine_close(sizeof(args), (Uint32 *)&args);
-            }
+        INFO("automatically deleting codec: %08x", (UInt32)args.in.codec);
+        args.in.pid = pid;
+        rpc_VIDDEC3_delete(sizeof(args), (Uint32 *)&args);
+    }
+
+    while (TRUE) {
+        Engine_close__args args;
+
+        key = Task_disable();
+        c = get_client(pid);
+        args.in.engine = (c && c->engines) ? c->engines->handle : 0;
+        Task_restore(key);
+
+        if (!args.in.engine) {
+            break;
         }
+
+        INFO("automatically closing engine: %08x", (UInt32)args.in.engine);
+        args.in.pid = pid;
+        rpc_Engine_close(sizeof(args), (Uint32 *)&args);
     }
 }
 #endif
@@ -837,44 +4577,76 @@ static void dce_cleanup_cb (slpm_eventType evt, UInt32 pid, int *err)
 int dce_init(void)
 {
     int err = 0;
-    Rcm_Params params = {0};
 
 #ifdef SERVER
-    Int32 appm3;
+    Rcm_Params params = {0};
     RcmServer_ThreadPoolDesc pool = {
             .name = "General Pool",
             .count = 3,
             .priority = Thread_Priority_NORMAL,
     };
-#endif
+#  ifndef LOOPBACK
+    Int32 appm3;
+#  endif
 
     Rcm_init();
     Rcm_Params_init(&params);
 
-#ifdef SERVER
     params.workerPools.length = 1;
     params.workerPools.elem = &pool;
-#else
-    params.heapId = 1; //XXX do I need this?
-#endif
 
     err = Rcm_create(SERVER_NAME, &params, &handle);
+#else
+#  ifdef LOOPBACK
+    transport = &loopback_transport;
+#  else
+    transport = &rcm_transport;
+#  endif
+
+    err = transport->create(SERVER_NAME);
+#endif
     if (err < 0) {
         ERROR("failed to create " SERVER_NAME ": 0x%08x", err);
         return err;
     }
 
+#ifndef SERVER
+    symtab = get_symbols();
+#endif
+
     /* Local Function Registration starts on  RCM server */
+    SETUP_FXN(handle, dce_get_symbols);
     SETUP_FXN(handle, Engine_open);
     SETUP_FXN(handle, Engine_close);
     SETUP_FXN(handle, VIDDEC3_create);
     SETUP_FXN(handle, VIDDEC3_control);
     SETUP_FXN(handle, VIDDEC3_process);
+    SETUP_FXN(handle, VIDDEC3_processBatch);
+    SETUP_FXN(handle, VIDDEC3_processInline);
+    SETUP_FXN(handle, VIDDEC3_processDelta);
     SETUP_FXN(handle, VIDDEC3_delete);
+    SETUP_FXN(handle, dce_get_mem_stats);
+    SETUP_FXN(handle, dce_set_mem_walk);
+    SETUP_FXN(handle, dce_set_frame_period);
+    SETUP_FXN(handle, dce_get_ivahd_stats);
+    SETUP_FXN(handle, dce_set_weight);
+    SETUP_FXN(handle, dce_ring_attach);
+    SETUP_FXN(handle, dce_ring_detach);
+
+#ifndef SERVER
+    free(symtab);
+    symtab = NULL;
+#endif
 
 #ifdef SERVER
+    err = ring_setup();
+    if (err < 0) {
+        ERROR("could not register ring doorbell: %08x", err);
+    }
+
     RcmServer_start(handle);
 
+#  ifndef LOOPBACK
     err = slpm_request_pm_resource(&appm3, slpm_APPM3, NULL);
     if (err) {
         ERROR("could not request appm3");
@@ -884,6 +4656,13 @@ int dce_init(void)
     if (err) {
         ERROR("could not register resource cleanup callback");
     }
+#  endif
+#else
+    if (getenv("DCE_TRANSPORT") && !strcmp(getenv("DCE_TRANSPORT"), "ring")) {
+        ring_init();
+    }
+
+    DEBUG("transport: %s", transport->name);
 #endif
 
     DEBUG(SERVER_NAME " running");
@@ -897,15 +4676,24 @@ int dce_deinit(void)
 
     DEBUG("shutdown");
 
+#ifdef SERVER
+    ring_teardown();
+
     if (handle) {
         err = Rcm_delete(&handle);
-        if (err < 0) {
-            ERROR("failed to delete " SERVER_NAME ": %08x", err);
-        }
         handle = NULL;
     }
 
     Rcm_exit();
+#else
+    ring_deinit();
+    msgcache_flush(&cache);
+
+    err = transport->destroy();
+#endif
+    if (err < 0) {
+        ERROR("failed to delete " SERVER_NAME ": %08x", err);
+    }
 
     DEBUG("deleted " SERVER_NAME);
 
@@ -916,10 +4704,12 @@ int dce_deinit(void)
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 static int count = 0;
 
-static void init(void)
+/* each Engine_open() or dce_preinit() holds a reference, the first one
+ * brings up the connection to ducati:
+ */
+static int init(void)
 {
-    int err;
-    Ipc_Config config = {0};
+    int err = 0;
 
     pthread_mutex_lock(&mutex);
 
@@ -927,20 +4717,22 @@ static void init(void)
         goto out;
     }
 
-    count++;
-
-    Ipc_getConfig(&config);
-
-    err = Ipc_setup(&config);
-    DEBUG("Ipc_setup() -> %08x", err);
-
     pid = getpid();
 
     err = dce_init();
     DEBUG("dce_init() -> %08x", err);
+    if (err < 0) {
+        /* undo partial setup, so a later call can retry: */
+        dce_deinit();
+        goto fail;
+    }
 
 out:
+    count++;
+    err = 0;
+fail:
     pthread_mutex_unlock(&mutex);
+    return err;
 }
 
 static void deinit(void)
@@ -949,19 +4741,31 @@ static void deinit(void)
 
     pthread_mutex_lock(&mutex);
 
-    count--;
-
-    if (count > 0) {
+    if (--count > 0) {
         goto out;
     }
 
     err = dce_deinit();
     DEBUG("dce_deinit() -> %08x", err);
 
-    err = Ipc_destroy();
-    DEBUG("Ipc_destroy() -> %08x", err);
-
 out:
     pthread_mutex_unlock(&mutex);
 }
+
+/**
+ * Bring up IPC and the connection to ducati, and resolve the remote
+ * functions, ahead of the first Engine_open().  Otherwise this happens
+ * in the first Engine_open(), which adds to the latency of the first
+ * frame.  The connection is kept until dce_preinit_release() (and any
+ * open engines are closed).
+ */
+int dce_preinit(void)
+{
+    return init();
+}
+
+void dce_preinit_release(void)
+{
+    deinit();
+}
 #endif
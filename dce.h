@@ -33,6 +33,8 @@
 #ifndef __DCE_H__
 #define __DCE_H__
 
+#include <ti/sdo/ce/video3/viddec3.h>
+
 /* other than the codec-engine API, you must use the following two functions
  * to allocate the data structures passed to codec-engine APIs (other than the
  * raw input/output buffers which should be passed as physical addresses in
@@ -41,4 +43,177 @@
 void * dce_alloc(int sz);
 void dce_free(void *ptr);
 
+/* same as dce_alloc(), but without zeroing the block: */
+void * dce_alloc_nozero(int sz);
+
+/* register user allocated buffers (which must be mapped to ducati, ie.
+ * allocated from tiler), so their host addresses can be used in the buffer
+ * descriptors, rather than looking up their ducati address:
+ */
+int dce_register_buffer(void *ptr, int len);
+int dce_unregister_buffer(void *ptr);
+
+/* all the structures for a decode session, in a single allocation, see
+ * dce_session_alloc():
+ */
+struct dce_session {
+    VIDDEC3_Params        *params;
+    VIDDEC3_DynamicParams *dynParams;
+    VIDDEC3_Status        *status;
+    XDM2_BufDesc          *inBufs;
+    XDM2_BufDesc          *outBufs;
+    VIDDEC3_InArgs        *inArgs;
+    VIDDEC3_OutArgs       *outArgs;
+    void                  *base;  /* private */
+};
+
+/* sizes of the (possibly codec specific extended) structures, zero for
+ * the size of the base VIDDEC3 structure:
+ */
+struct dce_session_layout {
+    int params;
+    int dynParams;
+    int status;
+    int inArgs;
+    int outArgs;
+};
+
+int dce_session_alloc(struct dce_session *s,
+        const struct dce_session_layout *layout);
+void dce_session_free(struct dce_session *s);
+
+/* optionally bring up the connection to ducati before Engine_open(): */
+int dce_preinit(void);
+void dce_preinit_release(void);
+
+/* RCM message cache statistics, see dce_get_msgcache_stats() */
+struct dce_msgcache_stats {
+    unsigned int hits;            /* msgs recycled from a cache */
+    unsigned int allocs;          /* msgs allocated with RcmClient_alloc() */
+    unsigned int alloc_failures;  /* failed RcmClient_alloc()'s */
+    unsigned int exhausted;       /* times a cache was found empty */
+};
+
+void dce_get_msgcache_stats(struct dce_msgcache_stats *stats);
+
+/* allow several VIDDEC3_processAsync() calls in flight on a codec: */
+#define DCE_MAX_QUEUE_DEPTH 4
+
+int dce_set_queue_depth(VIDDEC3_Handle codec, int depth);
+
+/* decode several frames in a single round trip to ducati: */
+#define DCE_MAX_BATCH 8
+
+XDAS_Int32 VIDDEC3_processBatch(VIDDEC3_Handle codec, XDAS_Int32 n,
+        XDM2_BufDesc *inBufs[], XDM2_BufDesc *outBufs[],
+        VIDDEC3_InArgs *inArgs[], VIDDEC3_OutArgs *outArgs[],
+        XDAS_Int32 *processed);
+
+/* pool of output frames, with reference counting, see
+ * dce_frame_pool_create():
+ */
+struct dce_frame {
+    XDAS_Int8 *y, *uv;            /* for outBufs->descs[0] and [1] */
+    XDAS_Int32 id;                /* for inArgs->inputID */
+    void      *priv;              /* for the caller */
+};
+
+struct dce_frame_pool;
+
+struct dce_frame_pool * dce_frame_pool_create(int max);
+void dce_frame_pool_delete(struct dce_frame_pool *pool);
+struct dce_frame * dce_frame_pool_add(struct dce_frame_pool *pool,
+        XDAS_Int8 *y, XDAS_Int8 *uv, void *priv);
+struct dce_frame * dce_frame_get(struct dce_frame_pool *pool);
+void dce_frame_ref(struct dce_frame *frame);
+void dce_frame_unref(struct dce_frame *frame);
+int dce_frame_pool_update(struct dce_frame_pool *pool,
+        VIDDEC3_OutArgs *outArgs, struct dce_frame **display, int max);
+
+/* cache of NV12 output buffer sets, see dce_buffers_get(): */
+#define DCE_MAX_BUFFERS     32
+#define DCE_TILER_STRIDE    4096  /* stride of 2D tiler buffers */
+
+struct dce_buffer {
+    char      *buf;               /* host address */
+    XDAS_Int8 *y, *uv;            /* for outBufs->descs[0] and [1] */
+};
+
+struct dce_buffers {
+    int width, height, stride;
+    int cnt;
+    struct dce_buffer bufs[DCE_MAX_BUFFERS];
+};
+
+struct dce_buffers * dce_buffers_get(int cnt, int width, int height,
+        int stride);
+void dce_buffers_put(struct dce_buffers *buffers);
+void dce_buffers_set_budget(unsigned int budget);
+
+/* memory usage on ducati, and of libdce on the host, see
+ * dce_get_mem_stats():
+ */
+enum {
+    DCE_MEM_HEAP0 = 0,            /* default heap, ie. codec instances */
+    DCE_MEM_HEAP1,                /* heapvideo, ie. algorithm memTab's */
+    DCE_MEM_TILED,                /* tiled memory IRES (tiler, or heap1) */
+    DCE_MEM_NUM
+};
+
+struct dce_heap_stats {
+    unsigned int size;
+    unsigned int used;
+    unsigned int max_block;       /* largest free block */
+};
+
+/* for heap0, total[], client[] and codec[] count the codec instances (ie.
+ * their memTab's), but not CE's own bookkeeping, which heap[0].used does:
+ */
+struct dce_mem_stats {
+    struct dce_heap_stats heap[2];        /* heap0, heap1 */
+    unsigned int total[DCE_MEM_NUM];      /* bytes used by all clients */
+    unsigned int client[DCE_MEM_NUM];     /* .. by this process */
+    unsigned int codec[DCE_MEM_NUM];      /* .. by the codec, if any */
+    unsigned int peak[DCE_MEM_NUM];       /* high water mark of total */
+    unsigned int allocs[DCE_MEM_NUM];     /* number of allocations */
+    unsigned int failed[DCE_MEM_NUM];     /* largest failed allocation */
+    unsigned int host_tiler;      /* tiler memory allocated by libdce */
+    unsigned int host_cached;     /* .. of which in cached buffer sets */
+};
+
+int dce_get_mem_stats(VIDDEC3_Handle codec, struct dce_mem_stats *stats);
+int dce_set_mem_walk(int on);
+
+/* IVA-HD clock scaling, see dce_set_frame_period() and
+ * dce_get_ivahd_stats():
+ */
+struct dce_ivahd_stats {
+    unsigned int opp;             /* current OPP: 0 (clock off), 50 or 100 */
+    unsigned int level;           /* OPP used when busy */
+    unsigned int load;            /* last measured, in % of OPP100 */
+    unsigned int switches;        /* number of OPP changes */
+    unsigned int opp_ms[3];       /* time spent at OPP 0, 50 and 100 */
+};
+
+int dce_set_frame_period(VIDDEC3_Handle codec, int usecs);
+int dce_get_ivahd_stats(struct dce_ivahd_stats *stats);
+
+/* sharing of the IVA-HD between codecs, see dce_set_weight() and
+ * dce_set_deadline():
+ */
+int dce_set_weight(VIDDEC3_Handle codec, int weight);
+void dce_set_deadline(VIDDEC3_Handle codec, int usecs);
+
+/* pass the buffer descriptors and args for VIDDEC3_process() and
+ * VIDDEC3_processAsync() by value, so they needn't be dce_alloc()'d.  The
+ * combined size of inArgs and outArgs is limited to:
+ */
+#define DCE_MAX_INLINE_ARGS 1024
+
+#define DCE_INLINE_OFF      0     /* pass by pointer (default) */
+#define DCE_INLINE_ON       1     /* pass by value */
+#define DCE_INLINE_DELTA    2     /* pass by value, only what changed */
+
+int dce_set_inline_args(VIDDEC3_Handle codec, int mode);
+
 #endif /* __DCE_H__ */
@@ -37,9 +37,21 @@
 #  error "Must define either CLIENT or SERVER"
 #endif
 
+#include <stdint.h>
+
 int dce_init(void);
 int dce_deinit(void);
 
+/* address of a buffer or handle, as seen from ducati.  In the loopback
+ * build, the "remote" side is in the same process, so this needs to be
+ * wide enough to hold a host pointer.
+ */
+#ifdef LOOPBACK
+typedef uintptr_t DucatiAddr;
+#else
+typedef uint32_t  DucatiAddr;
+#endif
+
 #ifdef SERVER
 /* these acquire/release functions should be implemented by the platform,
  * ie. to use OMX RM if integrated with OMX build, or use directly slpm
@@ -48,12 +60,53 @@ int dce_deinit(void);
  */
 void ivahd_acquire(void);
 void ivahd_release(void);
+
+/* the platform's IVA-HD clock governor is told the total frame rate of
+ * the codecs which have one (in frames per 1000s, see
+ * dce_set_frame_period()), and reports what it is doing:
+ */
+struct dce_ivahd_stats;
+void ivahd_set_rate(unsigned int rate);
+void ivahd_get_stats(struct dce_ivahd_stats *stats);
+
+/* called by the platform's allocFxn()/freeFxn() and IRES managers, to
+ * account memory to the client on who's behalf it is allocated.  The type
+ * is one of DCE_MEM_x (see dce.h), and delta is negative for frees.  These
+ * are cheap counters, unlike Memory_getStats(), so fine to call on every
+ * alloc/free.  Failed allocations are reported with dce_mem_failed().
+ */
+void dce_mem_account(int type, int delta);
+void dce_mem_failed(int type, int size);
+
+/* set by dce_set_mem_walk(), for benchmarks: allocFxn()/freeFxn() should
+ * then also log Memory_getStats() for every memTab, as they used to:
+ */
+extern int dce_mem_walk;
+
+/* heapvideo (heap1) is managed by the platform's allocFxn(), so it is asked
+ * for the usage rather than the heap itself:
+ */
+struct dce_heap_stats;
+void heapvideo_stats(struct dce_heap_stats *stats);
 #endif
 
 #ifndef   DIM
 #  define DIM(a) (sizeof((a)) / sizeof((a)[0]))
 #endif
 
+#ifndef   MAX
+#  define MAX(a,b) (((a) > (b)) ? (a) : (b))
+#endif
+
+#ifndef   MIN
+#  define MIN(a,b) (((a) < (b)) ? (a) : (b))
+#endif
+
+/* align x up to multiple of n, which must be a power of two */
+#ifndef   ALIGN
+#  define ALIGN(x,n) (((x) + ((n) - 1)) & ~((n) - 1))
+#endif
+
 /* set desired trace level:
  *   3 - error
  *   2 - error, info
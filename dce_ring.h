@@ -0,0 +1,166 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __DCE_RING_H__
+#define __DCE_RING_H__
+
+/*
+ * Lock-free single-producer/single-consumer ring, living in memory shared
+ * between host and ducati.  Nothing in here depends on syslink or bios, the
+ * caller is responsible for placing the ring in shared memory and for
+ * delivering the doorbell (ie. Notify event) to the other side.
+ *
+ * Doorbells are coalesced: the consumer sets 'sleeping' before it blocks,
+ * and the producer only needs to ring the doorbell if it finds the flag
+ * set.  As long as the consumer keeps up, no interrupts are generated.
+ *
+ * The shared region used for the ring is not cached on ducati (see
+ * dce_app_m3.cfg), so only memory barriers are needed, no cache ops.
+ */
+
+#if defined(SERVER) && !defined(LOOPBACK)
+/* TMS470 doesn't do gcc builtins.. */
+#  define dce_ring_mb()   __asm(" dmb")
+#else
+#  define dce_ring_mb()   __sync_synchronize()
+#endif
+
+#define DCE_RING_CACHELINE 32
+
+typedef struct {
+    volatile Uint32 head;       /* next slot to fill, written by producer */
+    Uint32  pad0[(DCE_RING_CACHELINE / 4) - 1];
+    volatile Uint32 tail;       /* next slot to drain, written by consumer */
+    volatile Uint32 sleeping;   /* consumer waiting for doorbell */
+    Uint32  pad1[(DCE_RING_CACHELINE / 4) - 2];
+    Uint32  nslots;             /* must be power of two */
+    Uint32  slotsz;             /* in bytes, multiple of 4 */
+    Uint32  pad2[(DCE_RING_CACHELINE / 4) - 2];
+    Uint32  data[1];            /* nslots * slotsz bytes */
+} DceRing;
+
+/* size in bytes of a ring with the specified geometry: */
+#define DCE_RING_SIZE(nslots, slotsz) \
+        (sizeof(DceRing) - sizeof(Uint32) + ((nslots) * (slotsz)))
+
+static inline void dce_ring_init(DceRing *r, Uint32 nslots, Uint32 slotsz)
+{
+    r->head = 0;
+    r->tail = 0;
+    r->sleeping = 0;
+    r->nslots = nslots;
+    r->slotsz = slotsz;
+}
+
+static inline void * dce_ring_slot(DceRing *r, Uint32 idx)
+{
+    return (char *)r->data + ((idx & (r->nslots - 1)) * r->slotsz);
+}
+
+static inline Bool dce_ring_empty(DceRing *r)
+{
+    return r->head == r->tail;
+}
+
+/**
+ * Called by producer to add an entry.  Returns -1 if the ring is full, 1
+ * if the consumer is sleeping and the doorbell needs to be rung, otherwise
+ * 0.
+ */
+static inline Int dce_ring_put(DceRing *r, const void *entry)
+{
+    Uint32 head = r->head;
+
+    if ((head - r->tail) >= r->nslots) {
+        return -1;
+    }
+
+    memcpy(dce_ring_slot(r, head), entry, r->slotsz);
+
+    /* entry must be visible before the updated head: */
+    dce_ring_mb();
+    r->head = head + 1;
+
+    /* and head must be visible before we check for a sleeping consumer,
+     * which pairs with the barrier in dce_ring_sleep():
+     */
+    dce_ring_mb();
+    if (r->sleeping) {
+        r->sleeping = 0;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Called by consumer to remove an entry.  Returns -1 if the ring is empty,
+ * otherwise 0.
+ */
+static inline Int dce_ring_get(DceRing *r, void *entry)
+{
+    Uint32 tail = r->tail;
+
+    if (tail == r->head) {
+        return -1;
+    }
+
+    /* don't read the entry before we've seen the head: */
+    dce_ring_mb();
+    memcpy(entry, dce_ring_slot(r, tail), r->slotsz);
+
+    /* and finish reading the entry before the producer can reuse it: */
+    dce_ring_mb();
+    r->tail = tail + 1;
+
+    return 0;
+}
+
+/**
+ * Called by consumer, when it finds the ring empty, before it blocks
+ * waiting for the doorbell.  Returns FALSE if an entry arrived in the mean
+ * time, in which case the consumer should not block.  A doorbell can still
+ * arrive after FALSE is returned, so the consumer must tolerate spurious
+ * wakeups.
+ */
+static inline Bool dce_ring_sleep(DceRing *r)
+{
+    r->sleeping = 1;
+    dce_ring_mb();
+    if (!dce_ring_empty(r)) {
+        r->sleeping = 0;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+#endif /* __DCE_RING_H__ */
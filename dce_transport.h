@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __DCE_TRANSPORT_H__
+#define __DCE_TRANSPORT_H__
+
+/*
+ * Client side transport.. how messages built by the client stubs in dce.c
+ * get to the rpc_* handlers on the server side.  The messages themselves
+ * are always RcmClient_Message's, whatever the transport, so the stubs
+ * don't need to care which one is in use:
+ *
+ *   rcm      - the normal case, RcmClient over syslink to ducati
+ *   loopback - server half of dce.c linked into the host process, and the
+ *              handlers called directly (see loopback.c).  For profiling
+ *              libdce itself on a host without ducati.
+ *
+ * All functions returning int return a negative value on error.
+ */
+
+typedef struct {
+    const char *name;
+    int  (*create)(String server);
+    int  (*destroy)(void);
+    int  (*get_symbol)(String name, UInt32 *idx);
+    int  (*alloc)(UInt32 sz, RcmClient_Message **msg);
+    void (*free)(RcmClient_Message *msg);
+    /* synchronous call, the reply may be returned in a different msg: */
+    int  (*exec)(RcmClient_Message *msg, RcmClient_Message **ret);
+    /* asynchronous call, the msg belongs to the transport until wait(): */
+    int  (*exec_nowait)(RcmClient_Message *msg, UInt16 *msgId);
+    int  (*wait)(UInt16 msgId, RcmClient_Message **ret);
+} Transport;
+
+/* provided by loopback.c in --enable-loopback builds: */
+extern const Transport loopback_transport;
+
+#endif /* __DCE_TRANSPORT_H__ */
@@ -41,6 +41,8 @@
 #include <xdc/cfg/global.h>
 
 #include "dce_priv.h"
+#include "dce.h"
+#include "heapvideo.h"
 
 //#include <ti/omap/mem/shim/MemMgr.h>
 #include <ti/omap/mem/SyslinkMemUtils.h>
@@ -51,8 +53,6 @@
 #include <ti/sdo/fc/ires/tiledmemory/iresman_tiledmemory.h>
 
 
-#define MEMORYSTATS_DEBUG 1
-
 void *MEMUTILS_getPhysicalAddr(Ptr vaddr)
 {
 	unsigned int paddr = SyslinkMemUtils_VirtToPhys(vaddr);
@@ -123,19 +123,33 @@ typedef struct {
 
 #define P2H(p) (&(((MemHeader *)(p))[-1]))
 
+/* what MEMORYSTATS_DEBUG used to log, see dce_set_mem_walk(): */
+static void memstats(void)
+{
+	Memory_Stats stats;
+
+	Memory_getStats(heap1, &stats);
+	INFO("Total: %d\tFree: %d\tLargest: %d", stats.totalSize,
+			stats.totalFreeSize, stats.largestFreeSize);
+}
+
 static Bool allocFxn(IALG_MemRec memTab[], Int n)
 {
 	Int i;
-#ifdef MEMORYSTATS_DEBUG
-	Memory_Stats stats;
-#endif
 
+	/* note: no Memory_getStats() here, it walks the heap's free list.  The
+	 * usage is counted by dce_mem_account() instead, unless dce_mem_walk
+	 * asks for the old behavior:
+	 */
 	for (i = 0; i < n; i++) {
-		Error_Block eb;
 		Uns pad, size;
 		void *blk;
 		MemHeader *hdr;
 
+		if (dce_mem_walk) {
+			memstats();
+		}
+
 		if (memTab[i].alignment > sizeof(MemHeader)) {
 			pad = memTab[i].alignment;
 		} else {
@@ -144,16 +158,16 @@ static Bool allocFxn(IALG_MemRec memTab[], Int n)
 
 		size = memTab[i].size + pad;
 
-#ifdef MEMORYSTATS_DEBUG
-		Memory_getStats(heap1, &stats);
-		INFO("Total: %d\tFree: %d\tLargest: %d", stats.totalSize,
-				stats.totalFreeSize, stats.largestFreeSize);
-#endif
+		blk = heapvideo_alloc(size, memTab[i].alignment);
 
-		blk = Memory_alloc(heap1, size, memTab[i].alignment, &eb);
+		/* free tiled memory blocks kept for reuse, and try again: */
+		if (!blk && tiledmemory_flush()) {
+			blk = heapvideo_alloc(size, memTab[i].alignment);
+		}
 
 		if (!blk) {
-			ERROR("MemTab Allocation failed at %d", i);
+			ERROR("MemTab Allocation failed at %d (%d)", i, size);
+			dce_mem_failed(DCE_MEM_HEAP1, size);
 			freeFxn(memTab, i);
 			return FALSE;
 		} else {
@@ -161,6 +175,7 @@ static Bool allocFxn(IALG_MemRec memTab[], Int n)
 			hdr = P2H(memTab[i].base);
 			hdr->size = size;
 			hdr->ptr  = blk;
+			dce_mem_account(DCE_MEM_HEAP1, size);
 			DEBUG("%d: alloc: %p/%p (%d)", i, hdr->ptr,
 					memTab[i].base, hdr->size);
 		}
@@ -172,24 +187,18 @@ static Bool allocFxn(IALG_MemRec memTab[], Int n)
 static void freeFxn(IALG_MemRec memTab[], Int n)
 {
 	Int i;
-#ifdef MEMORYSTATS_DEBUG
-	Memory_Stats stats;
-#endif
 
 	for (i = 0; i < n; i++) {
 		if (memTab[i].base != NULL) {
 			MemHeader *hdr = P2H(memTab[i].base);
 
-#ifdef MEMORYSTATS_DEBUG
-			DEBUG("%d: free: %p/%p (%d)", n, hdr->ptr,
+			DEBUG("%d: free: %p/%p (%d)", i, hdr->ptr,
 					memTab[i].base, hdr->size);
-#endif
-			Memory_free(heap1, hdr->ptr, hdr->size);
+			dce_mem_account(DCE_MEM_HEAP1, -(Int)hdr->size);
+			heapvideo_free(hdr->ptr, hdr->size);
+		}
+		if (dce_mem_walk) {
+			memstats();
 		}
-#ifdef MEMORYSTATS_DEBUG
-		Memory_getStats(heap1, &stats);
-		INFO("Total: %d\tFree: %d\tLargest: %d", stats.totalSize,
-				stats.totalFreeSize, stats.largestFreeSize);
-#endif
 	}
 }
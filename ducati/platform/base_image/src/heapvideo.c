@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2011, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Allocator for heapvideo (heap1), behind allocFxn()/freeFxn().
+ *
+ * heapvideo used to be used directly as a first-fit HeapMem, which after
+ * many create/delete cycles at mixed resolutions ends up with the large
+ * free areas broken up by the small long lived blocks that codecs allocate
+ * alongside their big buffers.  So VIDDEC3_create() could fail with plenty
+ * of free memory left.  Instead, all of heapvideo is taken at startup and
+ * managed here, in pages:
+ *
+ *  + large blocks are a whole number of pages, first-fit from the bottom
+ *    of the region, so the hole left by one is usable by others (at other
+ *    resolutions) rather than leaving odd slivers.
+ *
+ *  + small blocks (up to 16KB) are sub-allocated from chunks, per size
+ *    class, and chunks are allocated from the top of the region, so the
+ *    small blocks are kept together rather than scattered through the
+ *    large ones.  A chunk is given back once it is empty, unless it is the
+ *    last one of it's class with free blocks.
+ */
+
+#include <xdc/std.h>
+#include <xdc/runtime/System.h>
+#include <xdc/runtime/Memory.h>
+#include <xdc/runtime/Error.h>
+#include <xdc/cfg/global.h>
+#include <ti/sysbios/knl/Task.h>
+
+#include "dce_priv.h"
+#include "dce.h"
+#include "heapvideo.h"
+
+
+#define PAGE       0x1000
+#define CHUNK_MAX  0x10000        /* max size of a chunk */
+#define CHUNK_BLKS 32             /* blocks per chunk, unless > CHUNK_MAX */
+
+/*
+ * Pages.. the free pages are kept as extents, in a list in address order,
+ * so finding and freeing pages costs a walk of the free extents, of which
+ * there are only as many as there are holes, rather than a scan of every
+ * page in the region with task switching disabled:
+ */
+
+typedef struct Extent Extent;
+
+struct Extent {
+	Extent *next, *prev;
+	Uns     first, n;             /* in pages */
+};
+
+static char   *base = NULL;       /* page aligned start of the region */
+static Extent *head, *tail;       /* free extents, in address order */
+static Extent *spare;             /* unused Extent's, for reuse */
+static Uns     npages, nused;
+
+/* size of the largest free extent, and how many there are of that size,
+ * kept up to date as extents change so heapvideo_stats() is cheap.  When
+ * the last of them shrinks, it is marked stale, and found again by
+ * largest_fix() once the extents are settled.  Sizes that appear must be
+ * added before the ones they replace are removed:
+ */
+static Uns     largest, nlargest;
+static Bool    largest_stale;
+
+static void largest_add(Uns n)
+{
+	if (largest_stale) {
+		return;
+	}
+	if (n > largest) {
+		largest = n;
+		nlargest = 1;
+	} else if (n == largest) {
+		nlargest++;
+	}
+}
+
+static void largest_del(Uns n)
+{
+	if (!largest_stale && (n == largest) && !--nlargest) {
+		largest_stale = TRUE;
+	}
+}
+
+static void largest_fix(void)
+{
+	Extent *e;
+
+	if (largest_stale) {
+		largest = nlargest = 0;
+		largest_stale = FALSE;
+		for (e = head; e; e = e->next) {
+			largest_add(e->n);
+		}
+	}
+}
+
+/* called with task switching disabled */
+static Extent * extent_new(Uns first, Uns n)
+{
+	Error_Block eb;
+	Extent *e = spare;
+
+	if (e) {
+		spare = e->next;
+	} else {
+		Error_init(&eb);
+		e = Memory_alloc(NULL, sizeof(*e), 0, &eb);
+		if (!e) {
+			return NULL;
+		}
+	}
+
+	e->first = first;
+	e->n = n;
+
+	return e;
+}
+
+/* link e in between prev and next (either of which can be NULL) */
+static void extent_link(Extent *e, Extent *prev, Extent *next)
+{
+	e->prev = prev;
+	e->next = next;
+	*(prev ? &prev->next : &head) = e;
+	*(next ? &next->prev : &tail) = e;
+}
+
+static void extent_unlink(Extent *e)
+{
+	*(e->prev ? &e->prev->next : &head) = e->next;
+	*(e->next ? &e->next->prev : &tail) = e->prev;
+	e->next = spare;
+	spare = e;
+}
+
+/* take all of heapvideo, called with task switching disabled */
+static Bool region_init(void)
+{
+	Memory_Stats stats;
+	Error_Block eb;
+	SizeT size;
+	Extent *e;
+
+	Error_init(&eb);
+	Memory_getStats(heap1, &stats);
+
+	size = stats.largestFreeSize & ~(PAGE - 1);
+	while (size && !(base = Memory_alloc(heap1, size, PAGE, &eb))) {
+		/* if the page alignment didn't fit: */
+		size -= PAGE;
+	}
+	if (!base) {
+		ERROR("could not allocate region");
+		return FALSE;
+	}
+
+	npages = size / PAGE;
+	e = extent_new(0, npages);
+	if (!e) {
+		ERROR("could not allocate extent");
+		Memory_free(heap1, base, size);
+		base = NULL;
+		return FALSE;
+	}
+	extent_link(e, NULL, NULL);
+	largest_add(npages);
+
+	INFO("heapvideo: %d pages at %p", npages, base);
+
+	return TRUE;
+}
+
+/* take pages [first, first + n) out of free extent e */
+static Bool extent_take(Extent *e, Uns first, Uns n)
+{
+	Uns end = e->first + e->n, old = e->n;
+	Extent *x;
+
+	if ((first > e->first) && ((first + n) < end)) {
+		/* a hole in the middle, so it splits in two: */
+		x = extent_new(first + n, end - (first + n));
+		if (!x) {
+			return FALSE;
+		}
+		extent_link(x, e, e->next);
+		e->n = first - e->first;
+		largest_add(x->n);
+		largest_add(e->n);
+	} else if (first > e->first) {
+		e->n = first - e->first;
+		largest_add(e->n);
+	} else if ((first + n) < end) {
+		e->first = first + n;
+		e->n = end - e->first;
+		largest_add(e->n);
+	} else {
+		extent_unlink(e);
+	}
+
+	largest_del(old);
+	largest_fix();
+
+	nused += n;
+
+	return TRUE;
+}
+
+/* allocate n pages, starting on a multiple of align pages, from the bottom
+ * of the region, or from the top.  Called with task switching disabled.
+ */
+static char * pages_alloc(Uns n, Uns align, Bool top)
+{
+	Extent *e;
+	Uns first, skew;
+
+	if (!base && !region_init()) {
+		return NULL;
+	}
+
+	/* base is only page aligned, so align the address not the index: */
+	skew = ((UInt32)base / PAGE) % align;
+
+	for (e = top ? tail : head; e; e = top ? e->prev : e->next) {
+		if (e->n < n) {
+			continue;
+		}
+		if (top) {
+			first = e->first + e->n - n;
+			if (((first + skew) % align) > (first - e->first)) {
+				continue;
+			}
+			first -= (first + skew) % align;
+		} else {
+			first = e->first + ((align - ((e->first + skew) % align)) % align);
+			if ((first + n) > (e->first + e->n)) {
+				continue;
+			}
+		}
+		if (!extent_take(e, first, n)) {
+			return NULL;
+		}
+		return base + (first * PAGE);
+	}
+
+	return NULL;
+}
+
+/* called with task switching disabled */
+static void pages_free(char *p, Uns n)
+{
+	Uns first = (p - base) / PAGE;
+	Extent *prev, *next, *e;
+
+	for (next = head; next && (next->first < first); next = next->next) {
+	}
+	prev = next ? next->prev : tail;
+
+	/* merge with the free pages either side: */
+	if (prev && ((prev->first + prev->n) == first)) {
+		Uns old = prev->n;
+		prev->n += n;
+		if (next && ((prev->first + prev->n) == next->first)) {
+			prev->n += next->n;
+			largest_add(prev->n);
+			largest_del(next->n);
+			extent_unlink(next);
+		} else {
+			largest_add(prev->n);
+		}
+		largest_del(old);
+	} else if (next && ((first + n) == next->first)) {
+		next->first = first;
+		next->n += n;
+		largest_add(next->n);
+		largest_del(next->n - n);
+	} else {
+		e = extent_new(first, n);
+		if (!e) {
+			ERROR("could not allocate extent, %d pages lost", n);
+			return;
+		}
+		extent_link(e, prev, next);
+		largest_add(n);
+	}
+
+	largest_fix();
+
+	nused -= n;
+}
+
+/*
+ * Chunks of small blocks, two classes per power of two.  The natural
+ * alignment of a block in a chunk is the lowest set bit of it's class size
+ * (up to PAGE):
+ */
+
+static const Uns sizes[] = {
+		32,   48,   64,   96,   128,  192,  256,  384,  512,  768,
+		1024, 1536, 2048, 3072, 4096, 6144, 8192, 12288, 16384,
+};
+
+typedef struct Chunk Chunk;
+
+struct Chunk {
+	Chunk *next;
+	char  *base;
+	Uns    size;
+	void  *free;                  /* free blocks, linked through 1st word */
+	Uns    nfree, nblks;
+};
+
+static Chunk *chunks[DIM(sizes)];
+
+/* class for a block of size, or -1 for a large block */
+static Int size_class(SizeT size)
+{
+	Int cls;
+
+	for (cls = 0; cls < DIM(sizes); cls++) {
+		if (size <= sizes[cls]) {
+			return cls;
+		}
+	}
+
+	return -1;
+}
+
+static Uns class_align(Int cls)
+{
+	return MIN(sizes[cls] & -sizes[cls], PAGE);
+}
+
+/* called with task switching disabled */
+static Chunk * chunk_new(Int cls)
+{
+	Error_Block eb;
+	Chunk *c;
+	Uns i;
+
+	Error_init(&eb);
+	c = Memory_alloc(NULL, sizeof(*c), 0, &eb);
+	if (!c) {
+		return NULL;
+	}
+
+	c->size = MIN(ALIGN(sizes[cls] * CHUNK_BLKS, PAGE), CHUNK_MAX);
+	c->base = pages_alloc(c->size / PAGE, 1, TRUE);
+	if (!c->base) {
+		Memory_free(NULL, c, sizeof(*c));
+		return NULL;
+	}
+
+	c->nblks = c->nfree = c->size / sizes[cls];
+	c->free  = NULL;
+	for (i = c->nblks; i > 0; i--) {
+		void **blk = (void **)(c->base + ((i - 1) * sizes[cls]));
+		*blk = c->free;
+		c->free = blk;
+	}
+
+	c->next = chunks[cls];
+	chunks[cls] = c;
+
+	DEBUG("new chunk: %p (%d x %d)", c->base, c->nblks, sizes[cls]);
+
+	return c;
+}
+
+/* called with task switching disabled */
+static void chunk_free(Int cls, Chunk *c)
+{
+	Chunk **p;
+
+	for (p = &chunks[cls]; *p != c; p = &(*p)->next) {
+	}
+	*p = c->next;
+
+	DEBUG("free chunk: %p (%d x %d)", c->base, c->nblks, sizes[cls]);
+
+	pages_free(c->base, c->size / PAGE);
+	Memory_free(NULL, c, sizeof(*c));
+}
+
+/**
+ * Allocate a block from heapvideo, returns NULL on failure.
+ */
+Ptr heapvideo_alloc(SizeT size, SizeT align)
+{
+	Int cls = size_class(size);
+	void **blk = NULL;
+	Chunk *c;
+	UInt key;
+
+	key = Task_disable();
+
+	if ((cls < 0) || (align > class_align(cls))) {
+		blk = (void **)pages_alloc(ALIGN(size, PAGE) / PAGE,
+				MAX(align, PAGE) / PAGE, FALSE);
+		goto out;
+	}
+
+	for (c = chunks[cls]; c && !c->nfree; c = c->next) {
+	}
+
+	if (!c) {
+		c = chunk_new(cls);
+	}
+
+	if (c) {
+		blk = c->free;
+		c->free = *blk;
+		c->nfree--;
+	}
+
+out:
+	Task_restore(key);
+
+	return blk;
+}
+
+/**
+ * Free a block allocated with heapvideo_alloc(), size must be the same as
+ * when it was allocated.
+ */
+Void heapvideo_free(Ptr ptr, SizeT size)
+{
+	Int cls = size_class(size);
+	char *p = ptr;
+	Chunk *c = NULL, *other;
+	UInt key;
+
+	key = Task_disable();
+
+	/* a small block could still have been too aligned for it's class: */
+	if (cls >= 0) {
+		for (c = chunks[cls]; c; c = c->next) {
+			if ((p >= c->base) && (p < (c->base + c->size))) {
+				break;
+			}
+		}
+	}
+
+	if (!c) {
+		pages_free(p, ALIGN(size, PAGE) / PAGE);
+		goto out;
+	}
+
+	*(void **)p = c->free;
+	c->free = p;
+	c->nfree++;
+
+	/* give back empty chunks, but keep one with free blocks per class, to
+	 * avoid thrashing:
+	 */
+	if (c->nfree == c->nblks) {
+		for (other = chunks[cls]; other; other = other->next) {
+			if ((other != c) && other->nfree) {
+				chunk_free(cls, c);
+				break;
+			}
+		}
+	}
+
+out:
+	Task_restore(key);
+}
+
+/**
+ * Usage of heapvideo, for dce_get_mem_stats().  Memory_getStats() would
+ * show all of it as used, since it is all taken by the region.
+ */
+void heapvideo_stats(struct dce_heap_stats *stats)
+{
+	UInt key;
+
+	key = Task_disable();
+
+	if (!base) {
+		Memory_Stats s;
+		Task_restore(key);
+		Memory_getStats(heap1, &s);
+		stats->size      = s.totalSize;
+		stats->used      = s.totalSize - s.totalFreeSize;
+		stats->max_block = s.largestFreeSize;
+		return;
+	}
+
+	stats->size      = npages * PAGE;
+	stats->used      = nused * PAGE;
+	stats->max_block = largest * PAGE;
+
+	Task_restore(key);
+}
@@ -30,14 +30,41 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-/* This is a dummy implementation of "ti.sdo.fc.ires.tiledmemory"
- * that just allocates from the heap:
+/* Implementation of "ti.sdo.fc.ires.tiledmemory".  The 2D access units
+ * get a 2D tiler container, and IRES_TILEDMEMORY_PAGE a 1D one, allocated
+ * with MemMgr.  IRES_TILEDMEMORY_RAW, and anything the tiler can't satisfy,
+ * gets a plain block from heapvideo, with isTiledMemory FALSE, which is
+ * what every block used to get.
+ *
+ * Freed blocks are kept, with their handles, in a pool for reuse by the
+ * next codec instance.  Creating a codec at the same resolution as the
+ * last one then needs no allocations at all, and the blocks aren't being
+ * continually freed and allocated again at different places.  The pool is
+ * keyed on the requested geometry, so blocks are only reused for the same
+ * sizeDim0 x sizeDim1 and access unit, and if they are aligned enough.
+ *
+ * The pool is bounded by POOL_MAX, and can be flushed by allocFxn() when
+ * heapvideo runs out, see tiledmemory_flush().
+ *
+ * On ducati MemMgr is the shim, which allocates from the tiler with an RCM
+ * call to the host's memsrv, so getHandles() makes a nested RCM call from
+ * the RcmServer thread that is running VIDDEC3_create().  That is safe as
+ * long as it is never made with task switching disabled (the pool lock),
+ * since the reply is pended on, and memsrv never calls back in to dce, so
+ * nothing it waits for can be stuck behind us.  The same goes for
+ * MemMgr_Free(), from freeHandles() and tiledmemory_flush().  If there is
+ * no memsrv the call just fails, and the block comes from heapvideo.
  */
 
+#include <string.h>
+
 #include <xdc/std.h>
 #include <xdc/runtime/System.h>
 #include <xdc/runtime/Memory.h>
 #include <xdc/runtime/Assert.h>
+#include <ti/sysbios/knl/Task.h>
+#include <ti/omap/mem/shim/MemMgr.h>
+#include <ti/omap/mem/SyslinkMemUtils.h>
 
 #include <ti/xdais/ires.h>
 
@@ -45,36 +72,154 @@
 #include <ti/sdo/fc/ires/tiledmemory/ires_tiledmemory.h>
 
 #include "dce_priv.h"
+#include "dce.h"
+#include "heapvideo.h"
+
+
+#define POOL_MAX   0x800000       /* max bytes of free blocks kept */
+
+typedef struct Res Res;
+
+struct Res {
+	IRES_TILEDMEMORY_Obj obj;     /* must be first */
+	Res   *next;                  /* in pool, while free */
+	IRES_TILEDMEMORY_AccessUnit unit;
+	Int    dim0, dim1;
+	Int    size;                  /* in bytes */
+	Bool   tiled;                 /* from MemMgr, rather than heapvideo */
+};
+
+static Res *pool = NULL;          /* most recently freed first */
+
+/* size in bytes of a block of the requested geometry.  For the 2D units,
+ * sizeDim0 is in elements of the unit, as for a MemMgr 2D block, so they
+ * are dim0 elements of the unit's size by dim1 lines.  This is also the
+ * size of the heapvideo block they fall back to, which needs the element
+ * size, or 16 and 32 bit blocks would be a half or a quarter too small.
+ */
+static Int res_size(IRES_TILEDMEMORY_ProtocolArgs *args)
+{
+	Int elem, lines = args->sizeDim1 ? args->sizeDim1 : 1;
+
+	switch (args->accessUnit) {
+	case IRES_TILEDMEMORY_8BIT:  elem = 1; break;
+	case IRES_TILEDMEMORY_16BIT: elem = 2; break;
+	case IRES_TILEDMEMORY_32BIT: elem = 4; break;
+	default:                     elem = 1; break;
+	}
 
+	return args->sizeDim0 * elem * lines;
+}
+
+/* try for a real tiler block, NULL if the unit isn't tiled, or there is
+ * no room in the tiler.  Makes an RCM call, so not with the pool locked:
+ */
+static Void * tiler_alloc(IRES_TILEDMEMORY_ProtocolArgs *args)
+{
+	MemAllocBlock block;
 
-static IRESMAN_PersistentAllocFxn * allocFxn;   /* Memory alloc function */
-static IRESMAN_PersistentFreeFxn * freeFxn;     /* Memory free function */
+	memset(&block, 0, sizeof(block));
+
+	switch (args->accessUnit) {
+	case IRES_TILEDMEMORY_8BIT:  block.pixelFormat = PIXEL_FMT_8BIT;  break;
+	case IRES_TILEDMEMORY_16BIT: block.pixelFormat = PIXEL_FMT_16BIT; break;
+	case IRES_TILEDMEMORY_32BIT: block.pixelFormat = PIXEL_FMT_32BIT; break;
+	case IRES_TILEDMEMORY_PAGE:  block.pixelFormat = PIXEL_FMT_PAGE;  break;
+	default:                     return NULL;
+	}
+
+	if (block.pixelFormat == PIXEL_FMT_PAGE) {
+		block.dim.len = res_size(args);
+	} else {
+		block.dim.area.width  = args->sizeDim0;
+		block.dim.area.height = args->sizeDim1 ? args->sizeDim1 : 1;
+	}
 
-static void * allocRes(int size)
+	return MemMgr_Alloc(&block, 1);
+}
+
+static void res_free(Res *r)
 {
-	IALG_MemRec rec = {
-			.size = size,
-			.alignment = 0x4,
-			.space = IALG_EXTERNAL,
-			.attrs = IALG_PERSIST,
-	};
-	if (! allocFxn(&rec, 1)) {
-		return NULL;
-	}
-	return rec.base;
+	if (r->tiled) {
+		MemMgr_Free(r->obj.memoryBaseAddress);
+	} else {
+		heapvideo_free(r->obj.memoryBaseAddress, r->size);
+	}
+	heapvideo_free(r, sizeof(*r));
 }
 
-static void freeRes(void *base, int size)
+/* take a matching block out of the pool, NULL if none */
+static Res * pool_get(IRES_TILEDMEMORY_ProtocolArgs *args)
 {
-	IALG_MemRec rec = {
-			.base = base,
-			.size = size,
-			.alignment = 0x4,
-			.space = IALG_EXTERNAL,
-			.attrs = IALG_PERSIST,
-	};
-
-	freeFxn(&rec, 1);
+	UInt32 align = MAX(args->alignment, 1);
+	Res **p, *r = NULL;
+	UInt key = Task_disable();
+
+	for (p = &pool; *p; p = &(*p)->next) {
+		if (((*p)->unit == args->accessUnit) &&
+				((*p)->dim0 == args->sizeDim0) &&
+				((*p)->dim1 == args->sizeDim1) &&
+				!((UInt32)(*p)->obj.memoryBaseAddress % align)) {
+			r = *p;
+			*p = r->next;
+			break;
+		}
+	}
+
+	Task_restore(key);
+
+	return r;
+}
+
+/* add a freed block to the pool, dropping the oldest ones if it gets too
+ * big.  The dropped blocks are returned, to be freed by the caller.
+ */
+static Res * pool_put(Res *r)
+{
+	Res **p, *drop = NULL;
+	Int total = 0;
+	UInt key = Task_disable();
+
+	r->next = pool;
+	pool = r;
+
+	for (p = &pool; *p; p = &(*p)->next) {
+		total += (*p)->size;
+		if (total > POOL_MAX) {
+			drop = *p;
+			*p = NULL;
+			break;
+		}
+	}
+
+	Task_restore(key);
+
+	return drop;
+}
+
+/**
+ * Free all the blocks in the pool, returns TRUE if there were any.
+ */
+Bool tiledmemory_flush(Void)
+{
+	UInt key = Task_disable();
+	Res *r = pool;
+
+	pool = NULL;
+
+	Task_restore(key);
+
+	if (!r) {
+		return FALSE;
+	}
+
+	while (r) {
+		Res *next = r->next;
+		res_free(r);
+		r = next;
+	}
+
+	return TRUE;
 }
 
 static String getProtocolName()
@@ -90,13 +235,12 @@ static IRES_ProtocolRevision * getProtocolRevision()
 
 static IRES_Status init(IRESMAN_Params * initArgs)
 {
-	allocFxn = initArgs->allocFxn;
-	freeFxn = initArgs->freeFxn;
 	return IRES_OK;
 }
 
 static IRES_Status exit()
 {
+	tiledmemory_flush();
 	return IRES_OK;
 }
 
@@ -112,47 +256,83 @@ static IRES_Handle getHandles(IALG_Handle algHandle,
 {
 	IRES_TILEDMEMORY_ProtocolArgs *args =
 			(IRES_TILEDMEMORY_ProtocolArgs *)resDesc->protocolArgs;
-	IRES_TILEDMEMORY_Handle handle = NULL;
+	Res *r;
 	Void *ptr = NULL;
+	Bool tiled = FALSE;
 	int size;
 
 	Assert_isTrue(args, NULL);
 	Assert_isTrue(algHandle, NULL);
 
-	size = args->sizeDim0;
-	if (args->sizeDim1)
-		size *= args->sizeDim1;
+	size = res_size(args);
+
+	r = pool_get(args);
+	if (r) {
+		DEBUG("reuse: %dx%d (%d)", args->sizeDim0, args->sizeDim1, size);
+		goto out;
+	}
 
 	DEBUG("alloc: %dx%d (%d)", args->sizeDim0, args->sizeDim1, size);
 
-	ptr = allocRes(size);
+	/* tiler blocks are at least page aligned: */
+	if (args->alignment <= 0x1000) {
+		ptr = tiler_alloc(args);
+		tiled = (ptr != NULL);
+	}
+	if (!ptr) {
+		ptr = heapvideo_alloc(size, MAX(args->alignment, 4));
+	}
+	if (!ptr && tiledmemory_flush()) {
+		ptr = heapvideo_alloc(size, MAX(args->alignment, 4));
+	}
 	if (!ptr) {
 		ERROR("could not allocate buffer: %dx%d (%d)",
 				args->sizeDim0, args->sizeDim1, size);
+		dce_mem_failed(DCE_MEM_TILED, size);
 		goto fail;
 	}
 
-	handle = allocRes(sizeof(*handle));
-	if (!handle) {
+	r = heapvideo_alloc(sizeof(*r), 4);
+	if (!r) {
 		ERROR("could not allocate handle");
 		goto fail;
 	}
 
-	handle->ires.getStaticProperties = getStaticProperties;
-	handle->ires.persistent = IRES_PERSISTENT;
-	handle->memoryBaseAddress = ptr;  /* MMU set up for 0x0 offset */
-	handle->systemSpaceBaseAddress = ptr;
-	handle->isTiledMemory = FALSE;
-	handle->accessUnit = IRES_TILEDMEMORY_RAW;
-	handle->tilerBaseAddress = NULL;
+	memset(r, 0, sizeof(*r));
+	r->unit = args->accessUnit;
+	r->dim0 = args->sizeDim0;
+	r->dim1 = args->sizeDim1;
+	r->size = size;
+	r->tiled = tiled;
+
+	r->obj.ires.getStaticProperties = getStaticProperties;
+	r->obj.ires.persistent = IRES_PERSISTENT;
+	r->obj.memoryBaseAddress = ptr;
+	r->obj.isTiledMemory = tiled;
+	r->obj.accessUnit = tiled ? args->accessUnit : IRES_TILEDMEMORY_RAW;
+	if (tiled) {
+		/* the tiler container's system space address, which isn't
+		 * where our MMU maps it:
+		 */
+		r->obj.systemSpaceBaseAddress =
+				(Void *)SyslinkMemUtils_VirtToPhys(ptr);
+		r->obj.tilerBaseAddress = r->obj.systemSpaceBaseAddress;
+	} else {
+		/* MMU set up for 0x0 offset: */
+		r->obj.systemSpaceBaseAddress = ptr;
+		r->obj.tilerBaseAddress = NULL;
+	}
 
-	DEBUG("allocation succeeded: %dx%d", args->sizeDim0, args->sizeDim1);
+	DEBUG("allocation succeeded: %dx%d%s", args->sizeDim0, args->sizeDim1,
+			tiled ? " (tiled)" : "");
 
-	return (IRES_Handle)handle;
+out:
+	dce_mem_account(DCE_MEM_TILED, size);
+	return (IRES_Handle)r;
 
 fail:
-	if (ptr)	freeRes(ptr, size);
-	if (handle)	freeRes(handle, sizeof(*handle));
+	if (ptr && tiled)	MemMgr_Free(ptr);
+	else if (ptr)	heapvideo_free(ptr, size);
 	return NULL;
 }
 
@@ -161,23 +341,21 @@ static IRES_Status freeHandles(IALG_Handle algHandle,
 		IRES_ResourceDescriptor *resDesc,
 		Int scratchGroupId)
 {
-	IRES_TILEDMEMORY_ProtocolArgs *args =
-			(IRES_TILEDMEMORY_ProtocolArgs *)resDesc->protocolArgs;
-	IRES_TILEDMEMORY_Handle handle =
-			(IRES_TILEDMEMORY_Handle)algResourceHandle;
-	int size;
+	Res *r = (Res *)algResourceHandle;
 
-	Assert_isTrue(args, NULL);
-	Assert_isTrue(handle, NULL);
+	Assert_isTrue(r, NULL);
 
-	size = args->sizeDim0;
-	if (args->sizeDim1)
-		size *= args->sizeDim1;
+	DEBUG("free: %dx%d (%d)", r->dim0, r->dim1, r->size);
 
-	DEBUG("free: %dx%d (%d)", args->sizeDim0, args->sizeDim1, size);
+	dce_mem_account(DCE_MEM_TILED, -r->size);
 
-	freeRes(handle->memoryBaseAddress, size);
-	freeRes(handle, sizeof(*handle));
+	/* what doesn't fit in the pool any more: */
+	r = pool_put(r);
+	while (r) {
+		Res *next = r->next;
+		res_free(r);
+		r = next;
+	}
 
 	return IRES_OK;
 }
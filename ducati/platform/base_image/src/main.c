@@ -46,6 +46,9 @@
 #include <ti/omap/slpm/idle.h>
 #include <ti/omap/mem/shim/MemMgr.h>
 #include <ti/sysbios/hal/Timer.h>
+#include <ti/sysbios/knl/Clock.h>
+#include <xdc/runtime/Timestamp.h>
+#include <xdc/runtime/Types.h>
 #include <ti/sysbios/heaps/HeapMem.h>
 
 #include <ti/sysbios/family/arm/ducati/GateDualCore.h>
@@ -59,6 +62,7 @@
 #include <ti/sdo/ce/global/CESettings.h>
 
 #include "dce_priv.h"
+#include "dce.h"
 
 #define PM_IVAHD_PWRSTCTRL        (*(volatile unsigned int *)0xAA306F00)
 #define RM_IVAHD_RSTCTRL          (*(volatile unsigned int *)0xAA306F10)
@@ -185,15 +189,139 @@ static inline void set_ivahd_opp(int opp)
     DEBUG("CM_DIV_M5_DPLL_IVA=%08x", CM_DIV_M5_DPLL_IVA);
 }
 
+/*
+ * IVA-HD DVFS governor.. rather than switching the clock on and off around
+ * every process() call, the clock is left at the selected OPP until the
+ * IVA-HD has been idle for IVAHD_HOLDOFF_MS, so back to back frames don't
+ * each pay for reprogramming the divider.  The OPP is selected every
+ * IVAHD_WINDOW_MS from the measured load, or the load predicted from the
+ * frame rates given by clients (see dce_set_frame_period()) if higher.
+ * Loads are in % of what the IVA-HD can do at OPP100, and there is a gap
+ * between the thresholds for going up and down, so it doesn't flip-flop.
+ */
+
+#ifndef IVAHD_HOLDOFF_MS
+#  define IVAHD_HOLDOFF_MS  40    /* idle time before the clock is cut */
+#endif
+#define IVAHD_WINDOW_MS     100
+#define IVAHD_LOAD_UP       40    /* to OPP100, ie. 80% busy at OPP50 */
+#define IVAHD_LOAD_DOWN     30    /* to OPP50, ie. 60% busy at OPP50 */
+
+#define OPP_IDX(opp)        ((opp) / 50)
+#define TICKS_TO_MS(t)      ((t) * Clock_tickPeriod / 1000)
+
+static struct {
+    Clock_Handle idle;            /* fires when idle for IVAHD_HOLDOFF_MS */
+    UInt32 ts_per_us;             /* Timestamp frequency */
+    Int    opp;                   /* current */
+    Int    level;                 /* OPP to use when busy, 50 or 100 */
+    UInt32 since;                 /* Clock ticks at last OPP change */
+    UInt32 residency[3];          /* ms at OPP 0, 50, 100 */
+    UInt32 switches;
+    UInt32 load;                  /* of last window */
+    UInt32 rate;                  /* frames per 1000s, from clients */
+    UInt32 busy_start;            /* Timestamp when acquired */
+    UInt32 win_start;             /* Clock ticks at start of window */
+    UInt32 win_busy;              /* us busy in window */
+    UInt32 win_calls;
+} gov = {
+        .level = 100,
+};
+
+/* call with interrupts disabled: */
+static void gov_residency(void)
+{
+    UInt32 now = Clock_getTicks();
+    gov.residency[OPP_IDX(gov.opp)] += TICKS_TO_MS(now - gov.since);
+    gov.since = now;
+}
+
+static void gov_set_opp(int opp)
+{
+    if (opp != gov.opp) {
+        gov_residency();
+        gov.switches++;
+        gov.opp = opp;
+        set_ivahd_opp(opp);
+    }
+}
+
+static void gov_update(void)
+{
+    UInt32 elapsed = TICKS_TO_MS(Clock_getTicks() - gov.win_start);
+    UInt32 scale = (gov.level == 50) ? 2 : 1;
+    UInt32 load;
+
+    if (elapsed < IVAHD_WINDOW_MS) {
+        return;
+    }
+
+    load = gov.win_busy / 10 / elapsed / scale;
+
+    /* time per call at OPP100, times the rate the clients want: */
+    if (gov.rate && gov.win_calls) {
+        UInt32 pred = (UInt32)((UInt64)(gov.win_busy / gov.win_calls / scale) *
+                gov.rate / 10000000);
+        load = MAX(load, pred);
+    }
+
+    if ((gov.level == 100) && (load < IVAHD_LOAD_DOWN)) {
+        gov.level = 50;
+    } else if ((gov.level == 50) && (load > IVAHD_LOAD_UP)) {
+        gov.level = 100;
+    }
+
+    DEBUG("load=%u%%, level=%d", load, gov.level);
+
+    gov.load = load;
+    gov.win_start = Clock_getTicks();
+    gov.win_busy = 0;
+    gov.win_calls = 0;
+}
+
+static Void gov_idle(UArg arg)
+{
+    UInt hwiKey = Hwi_disable();
+    if (!ivahd_use_cnt) {
+        DEBUG("ivahd idle");
+        gov_set_opp(0);
+    }
+    Hwi_restore(hwiKey);
+}
+
+static void gov_init(void)
+{
+    Types_FreqHz freq;
+    Clock_Params params;
+
+    Timestamp_getFreq(&freq);
+    gov.ts_per_us = MAX(freq.lo / 1000000, 1);
+
+    Clock_Params_init(&params);
+    params.period = 0;            /* one-shot */
+    gov.idle = Clock_create(gov_idle,
+            MAX(IVAHD_HOLDOFF_MS * 1000 / Clock_tickPeriod, 1), &params, NULL);
+    if (!gov.idle) {
+        ERROR("could not create idle clock");
+    }
+
+    gov.since = gov.win_start = Clock_getTicks();
+}
+
 void ivahd_acquire(void)
 {
     UInt hwiKey = Hwi_disable();
     if (++ivahd_use_cnt == 1) {
         DEBUG("ivahd acquire");
-        set_ivahd_opp(100);
+        if (gov.idle) {
+            Clock_stop(gov.idle);
+        }
+        gov_set_opp(gov.level);
+        gov.busy_start = Timestamp_get32();
     } else {
         DEBUG("ivahd already acquired");
     }
+    gov.win_calls++;
     Hwi_restore(hwiKey);
 }
 
@@ -202,13 +330,44 @@ void ivahd_release(void)
     UInt hwiKey = Hwi_disable();
     if (ivahd_use_cnt-- == 1) {
         DEBUG("ivahd release");
-        set_ivahd_opp(0);
+        gov.win_busy += (Timestamp_get32() - gov.busy_start) / gov.ts_per_us;
+        gov_update();
+        if (gov.idle) {
+            Clock_start(gov.idle);
+        } else {
+            gov_set_opp(0);
+        }
     } else {
         DEBUG("ivahd still in use");
     }
     Hwi_restore(hwiKey);
 }
 
+void ivahd_set_rate(unsigned int rate)
+{
+    UInt hwiKey = Hwi_disable();
+    gov.rate = rate;
+    Hwi_restore(hwiKey);
+}
+
+void ivahd_get_stats(struct dce_ivahd_stats *stats)
+{
+    UInt hwiKey = Hwi_disable();
+    int i;
+
+    gov_residency();
+
+    stats->opp      = gov.opp;
+    stats->level    = gov.level;
+    stats->load     = gov.load;
+    stats->switches = gov.switches;
+    for (i = 0; i < DIM(gov.residency); i++) {
+        stats->opp_ms[i] = gov.residency[i];
+    }
+
+    Hwi_restore(hwiKey);
+}
+
 #define REG32(A)   (*(volatile UInt32 *) (A))
 
 void platform_idle_processing()
@@ -228,6 +387,7 @@ void platform_init()
 
     /* clear HSDIVDER_CLKOUT2_DIV */
     set_ivahd_opp(0);
+    gov_init();
 
 	/* Set up interprocessor notifications */
 	DEBUG("Setting up IPC");
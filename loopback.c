@@ -0,0 +1,729 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Loopback build support.. the server half of dce.c is linked into the host
+ * process, built against loopback.h, and this provides what it would
+ * otherwise get from RcmServer, CE and the platform on ducati.  Plus the
+ * client side loopback transport, which calls straight into the rpc_*
+ * handlers that the server half registered.
+ *
+ * The codec is a null codec, which does nothing but fill in outArgs, so
+ * what is left to measure is the overhead of libdce itself (marshalling,
+ * message handling, handle/buffer translation, etc).
+ */
+
+#include "dce_priv.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "loopback.h"
+
+#include <ti/sdo/ce/Engine.h>
+#include <ti/sdo/ce/video3/viddec3.h>
+
+#include "dce.h"
+#include "dce_transport.h"
+
+/*
+ * RcmServer shim.. just a symbol table, indexed by function index:
+ */
+
+static struct {
+    String           name;
+    RcmServer_MsgFxn fxn;
+} symbols[32];
+static UInt32 nsymbols;
+
+Void RcmServer_init(Void)
+{
+}
+
+Void RcmServer_exit(Void)
+{
+}
+
+Void RcmServer_Params_init(RcmServer_Params *params)
+{
+    memset(params, 0, sizeof(*params));
+}
+
+Int RcmServer_create(String name, RcmServer_Params *params,
+        RcmServer_Handle *handle)
+{
+    nsymbols = 0;
+    *handle = (RcmServer_Handle)symbols;
+    return 0;
+}
+
+Int RcmServer_delete(RcmServer_Handle *handle)
+{
+    nsymbols = 0;
+    *handle = NULL;
+    return 0;
+}
+
+Int RcmServer_addSymbol(RcmServer_Handle handle, String name,
+        RcmServer_MsgFxn fxn, UInt32 *index)
+{
+    if (nsymbols >= DIM(symbols)) {
+        return -1;
+    }
+
+    symbols[nsymbols].name = name;
+    symbols[nsymbols].fxn  = fxn;
+    *index = nsymbols++;
+
+    return 0;
+}
+
+Void RcmServer_start(RcmServer_Handle handle)
+{
+}
+
+/*
+ * Task and heap shims:
+ */
+
+__thread Ptr lb_task_env = NULL;
+
+static pthread_mutex_t task_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+UInt lb_task_disable(Void)
+{
+    pthread_mutex_lock(&task_mutex);
+    return 0;
+}
+
+Void lb_task_restore(UInt key)
+{
+    pthread_mutex_unlock(&task_mutex);
+}
+
+/* heap0 and heap1, which are the same size as on ducati.  Like HeapMem,
+ * Memory_getStats() has to walk the heap, here the allocated blocks:
+ */
+struct LbBlock {
+    LbBlock *next, *prev;
+    UInt32   size;
+};
+
+LbHeap lb_heaps[2] = {
+        { .size = 0x01000000 },
+        { .size = 0x06000000 },
+};
+static pthread_mutex_t heap_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static Ptr heap_alloc(LbHeap *h, SizeT size)
+{
+    LbBlock *b = NULL;
+
+    pthread_mutex_lock(&heap_mutex);
+    if (size <= (h->size - h->used)) {
+        b = calloc(1, sizeof(*b) + size);
+    }
+    if (b) {
+        b->size = size;
+        b->next = h->blocks;
+        if (h->blocks) {
+            h->blocks->prev = b;
+        }
+        h->blocks = b;
+        h->used += size;
+    }
+    pthread_mutex_unlock(&heap_mutex);
+
+    return b ? (b + 1) : NULL;
+}
+
+static Void heap_free(LbHeap *h, Ptr block)
+{
+    LbBlock *b = (LbBlock *)block - 1;
+
+    pthread_mutex_lock(&heap_mutex);
+    if (b->next) {
+        b->next->prev = b->prev;
+    }
+    if (b->prev) {
+        b->prev->next = b->next;
+    } else {
+        h->blocks = b->next;
+    }
+    h->used -= b->size;
+    pthread_mutex_unlock(&heap_mutex);
+
+    free(b);
+}
+
+Void Memory_getStats(IHeap_Handle heap, Memory_Stats *stats)
+{
+    LbHeap *h = (LbHeap *)heap;
+    LbBlock *b;
+    SizeT used = 0;
+
+    pthread_mutex_lock(&heap_mutex);
+    for (b = h->blocks; b; b = b->next) {
+        used += b->size;
+    }
+    pthread_mutex_unlock(&heap_mutex);
+
+    stats->totalSize       = h->size;
+    stats->totalFreeSize   = h->size - used;
+    stats->largestFreeSize = stats->totalFreeSize;
+}
+
+void heapvideo_stats(struct dce_heap_stats *stats)
+{
+    LbHeap *h = &lb_heaps[1];
+
+    pthread_mutex_lock(&heap_mutex);
+    stats->size      = h->size;
+    stats->used      = h->used;
+    stats->max_block = h->size - h->used;
+    pthread_mutex_unlock(&heap_mutex);
+}
+
+Semaphore_Handle lb_semaphore_create(Int count)
+{
+    sem_t *sem = malloc(sizeof(sem_t));
+
+    if (sem && sem_init(sem, 0, count)) {
+        free(sem);
+        sem = NULL;
+    }
+
+    return sem;
+}
+
+Void lb_semaphore_delete(Semaphore_Handle *sem)
+{
+    if (*sem) {
+        sem_destroy(*sem);
+        free(*sem);
+        *sem = NULL;
+    }
+}
+
+struct lb_task {
+    pthread_t    thread;
+    Task_FuncPtr fxn;
+    UArg         arg0, arg1;
+    Ptr          env;
+};
+
+static void * task_main(void *arg)
+{
+    struct lb_task *t = arg;
+    lb_task_env = t->env;
+    t->fxn(t->arg0, t->arg1);
+    return NULL;
+}
+
+Task_Handle lb_task_create(Task_FuncPtr fxn, Task_Params *params)
+{
+    struct lb_task *t = malloc(sizeof(*t));
+
+    if (!t) {
+        return NULL;
+    }
+
+    t->fxn  = fxn;
+    t->arg0 = params->arg0;
+    t->arg1 = params->arg1;
+    t->env  = params->env;
+
+    if (pthread_create(&t->thread, NULL, task_main, t)) {
+        free(t);
+        return NULL;
+    }
+
+    return t;
+}
+
+Void lb_task_delete(Task_Handle *task)
+{
+    if (*task) {
+        pthread_join((*task)->thread, NULL);
+        free(*task);
+        *task = NULL;
+    }
+}
+
+/*
+ * Notify/SharedRegion shims, for the ring transport.  The host is proc 0
+ * and everything else is proc 1, so events sent to one are delivered to
+ * the callback that the other registered:
+ */
+
+#define PEER(procId)  ((procId) ^ 1)
+
+static struct {
+    UInt16              procId;
+    UInt32              eventId;
+    Notify_FnNotifyCbck fxn;
+    UArg                arg;
+} events[4];
+static pthread_mutex_t events_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+UInt16 MultiProc_getId(String name)
+{
+    return strcmp(name, "MPU") ? 1 : 0;
+}
+
+Int Notify_registerEvent(UInt16 procId, UInt16 lineId, UInt32 eventId,
+        Notify_FnNotifyCbck fxn, UArg arg)
+{
+    Int i, ret = -1;
+
+    pthread_mutex_lock(&events_mutex);
+    for (i = 0; i < DIM(events); i++) {
+        if (!events[i].fxn) {
+            events[i].procId  = procId;
+            events[i].eventId = eventId;
+            events[i].arg     = arg;
+            events[i].fxn     = fxn;
+            ret = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&events_mutex);
+
+    return ret;
+}
+
+Int Notify_unregisterEvent(UInt16 procId, UInt16 lineId, UInt32 eventId,
+        Notify_FnNotifyCbck fxn, UArg arg)
+{
+    Int i, ret = -1;
+
+    pthread_mutex_lock(&events_mutex);
+    for (i = 0; i < DIM(events); i++) {
+        if ((events[i].fxn == fxn) && (events[i].procId == procId) &&
+                (events[i].eventId == eventId)) {
+            events[i].fxn = NULL;
+            ret = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&events_mutex);
+
+    return ret;
+}
+
+Int Notify_sendEvent(UInt16 procId, UInt16 lineId, UInt32 eventId,
+        UInt32 payload, Bool waitClear)
+{
+    Notify_FnNotifyCbck fxn = NULL;
+    UArg arg = 0;
+    Int i;
+
+    pthread_mutex_lock(&events_mutex);
+    for (i = 0; i < DIM(events); i++) {
+        if (events[i].fxn && (events[i].procId == PEER(procId)) &&
+                (events[i].eventId == eventId)) {
+            fxn = events[i].fxn;
+            arg = events[i].arg;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&events_mutex);
+
+    if (!fxn) {
+        return -1;
+    }
+
+    fxn(PEER(procId), lineId, eventId, arg, payload);
+
+    return 0;
+}
+
+/* the one shared region only has room for one client's rings, which is
+ * all there is in loopback.  SRPtr's are offsets into it, so they still
+ * fit in 32 bits:
+ */
+static char shm[0x4000] __attribute__((aligned(4096)));
+static Bool shm_used = FALSE;
+
+Ptr SharedRegion_getHeap(UInt16 id)
+{
+    return shm;
+}
+
+Ptr SharedRegion_getPtr(SharedRegion_SRPtr srptr)
+{
+    return (srptr < sizeof(shm)) ? &shm[srptr] : NULL;
+}
+
+SharedRegion_SRPtr SharedRegion_getSRPtr(Ptr addr, UInt16 id)
+{
+    return (SharedRegion_SRPtr)((char *)addr - shm);
+}
+
+Ptr Memory_alloc(IHeap_Handle heap, SizeT size, SizeT align, Ptr eb)
+{
+    if ((heap == heap0) || (heap == heap1)) {
+        return heap_alloc((LbHeap *)heap, size);
+    }
+
+    if ((heap != shm) || (size > sizeof(shm)) ||
+            __sync_lock_test_and_set(&shm_used, TRUE)) {
+        return NULL;
+    }
+
+    memset(shm, 0, size);
+
+    return shm;
+}
+
+Void Memory_free(IHeap_Handle heap, Ptr block, SizeT size)
+{
+    if ((heap == heap0) || (heap == heap1)) {
+        heap_free((LbHeap *)heap, block);
+    } else if (block == shm) {
+        __sync_lock_release(&shm_used);
+    }
+}
+
+/*
+ * Loopback transport:
+ */
+
+/* processAsync() calls are actually executed synchronously, and the msg
+ * parked here until wait(), indexed by msgId:
+ */
+static RcmClient_Message *pending[32];
+static pthread_mutex_t pending_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int lb_create(String server)
+{
+    return lb_server_init();
+}
+
+static int lb_destroy(void)
+{
+    return lb_server_deinit();
+}
+
+static int lb_get_symbol(String name, UInt32 *idx)
+{
+    UInt32 i;
+
+    for (i = 0; i < nsymbols; i++) {
+        if (!strcmp(symbols[i].name, name)) {
+            *idx = i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int lb_alloc(UInt32 sz, RcmClient_Message **msg)
+{
+    RcmClient_Message *m = malloc(offsetof(RcmClient_Message, data) + sz);
+
+    if (!m) {
+        return -1;
+    }
+
+    m->dataSize = sz;
+    *msg = m;
+
+    return 0;
+}
+
+static void lb_free(RcmClient_Message *msg)
+{
+    free(msg);
+}
+
+static int lb_exec(RcmClient_Message *msg, RcmClient_Message **ret)
+{
+    if (msg->fxnIdx >= nsymbols) {
+        return -1;
+    }
+
+    msg->result = symbols[msg->fxnIdx].fxn(msg->dataSize, msg->data);
+    *ret = msg;
+
+    return 0;
+}
+
+static int lb_exec_nowait(RcmClient_Message *msg, UInt16 *msgId)
+{
+    int i, err;
+
+    pthread_mutex_lock(&pending_mutex);
+    for (i = 0; i < DIM(pending); i++) {
+        if (!pending[i]) {
+            pending[i] = msg;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pending_mutex);
+
+    if (i == DIM(pending)) {
+        return -1;
+    }
+
+    err = lb_exec(msg, &msg);
+    if (err < 0) {
+        pthread_mutex_lock(&pending_mutex);
+        pending[i] = NULL;
+        pthread_mutex_unlock(&pending_mutex);
+        return err;
+    }
+
+    *msgId = i;
+
+    return 0;
+}
+
+static int lb_wait(UInt16 msgId, RcmClient_Message **ret)
+{
+    RcmClient_Message *msg = NULL;
+
+    pthread_mutex_lock(&pending_mutex);
+    if (msgId < DIM(pending)) {
+        msg = pending[msgId];
+        pending[msgId] = NULL;
+    }
+    pthread_mutex_unlock(&pending_mutex);
+
+    if (!msg) {
+        return -1;
+    }
+
+    *ret = msg;
+
+    return 0;
+}
+
+const Transport loopback_transport = {
+        .name        = "loopback",
+        .create      = lb_create,
+        .destroy     = lb_destroy,
+        .get_symbol  = lb_get_symbol,
+        .alloc       = lb_alloc,
+        .free        = lb_free,
+        .exec        = lb_exec,
+        .exec_nowait = lb_exec_nowait,
+        .wait        = lb_wait,
+};
+
+/*
+ * Null codec.. every input is "decoded" into a frame which is displayed
+ * and released straight away, so no reordering or delay.  A flush (zero
+ * inputID) returns nothing.
+ */
+
+/* the null codec's resources, allocated from heap1 in NULLCODEC_NMEMTAB
+ * pieces, the way allocFxn() does on ducati.  The other tasks get to run
+ * in between, as they would on ducati, so creates in several threads
+ * overlap:
+ */
+#define NULLCODEC_MEMTAB  0x10000
+#define NULLCODEC_NMEMTAB 16
+
+typedef struct {
+    Int          frames;
+    IALG_MemRec  memTab[NULLCODEC_NMEMTAB];
+} NullCodec;
+
+/* what allocFxn()/freeFxn() log, when dce_mem_walk is set: */
+static Void memstats(Void)
+{
+    Memory_Stats stats;
+
+    Memory_getStats(heap1, &stats);
+    INFO("Total: %d\tFree: %d\tLargest: %d", (Int)stats.totalSize,
+            (Int)stats.totalFreeSize, (Int)stats.largestFreeSize);
+}
+
+static Void nullcodec_free(IALG_MemRec memTab[], Int n)
+{
+    Int i;
+
+    for (i = 0; i < n; i++) {
+        dce_mem_account(DCE_MEM_HEAP1, -(Int)memTab[i].size);
+        Memory_free(heap1, memTab[i].base, memTab[i].size);
+        if (dce_mem_walk) {
+            memstats();
+        }
+    }
+}
+
+static Bool nullcodec_alloc(IALG_MemRec memTab[], Int n)
+{
+    Int i;
+
+    for (i = 0; i < n; i++) {
+        if (dce_mem_walk) {
+            memstats();
+        }
+
+        memTab[i].size = NULLCODEC_MEMTAB / NULLCODEC_NMEMTAB;
+        memTab[i].base = Memory_alloc(heap1, memTab[i].size, 0, NULL);
+        if (!memTab[i].base) {
+            dce_mem_failed(DCE_MEM_HEAP1, memTab[i].size);
+            nullcodec_free(memTab, i);
+            return FALSE;
+        }
+        dce_mem_account(DCE_MEM_HEAP1, memTab[i].size);
+
+        sched_yield();
+    }
+
+    return TRUE;
+}
+
+Engine_Handle lb_Engine_open(String name, Engine_Attrs *attrs, Engine_Error *ec)
+{
+    Engine_Handle engine;
+
+    /* the only engine in dce_app_m3.cfg: */
+    if (strcmp(name, "ivahd_vidsvr")) {
+        if (ec) {
+            *ec = Engine_EEXIST;
+        }
+        return NULL;
+    }
+
+    engine = calloc(1, sizeof(Int));
+
+    if (ec) {
+        *ec = engine ? Engine_EOK : Engine_ENOMEM;
+    }
+
+    return engine;
+}
+
+Void lb_Engine_close(Engine_Handle engine)
+{
+    free(engine);
+}
+
+VIDDEC3_Handle lb_VIDDEC3_create(Engine_Handle engine, String name,
+        VIDDEC3_Params *params)
+{
+    NullCodec *c = Memory_alloc(heap0, sizeof(NullCodec), 0, NULL);
+
+    if (c && !nullcodec_alloc(c->memTab, NULLCODEC_NMEMTAB)) {
+        Memory_free(heap0, c, sizeof(NullCodec));
+        c = NULL;
+    }
+
+    return (VIDDEC3_Handle)c;
+}
+
+XDAS_Int32 lb_VIDDEC3_control(VIDDEC3_Handle codec, VIDDEC3_Cmd id,
+        VIDDEC3_DynamicParams *dynParams, VIDDEC3_Status *status)
+{
+    return VIDDEC3_EOK;
+}
+
+XDAS_Int32 lb_VIDDEC3_process(VIDDEC3_Handle codec,
+        XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
+        VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs)
+{
+    NullCodec *c = (NullCodec *)codec;
+
+    outArgs->extendedError    = 0;
+    outArgs->bytesConsumed    = inArgs->numBytes;
+    outArgs->outputID[0]      = inArgs->inputID;
+    outArgs->outputID[1]      = 0;
+    outArgs->freeBufID[0]     = inArgs->inputID;
+    outArgs->freeBufID[1]     = 0;
+    outArgs->outBufsInUseFlag = FALSE;
+
+    c->frames++;
+
+    return VIDDEC3_EOK;
+}
+
+Void lb_VIDDEC3_delete(VIDDEC3_Handle codec)
+{
+    NullCodec *c = (NullCodec *)codec;
+
+    DEBUG("codec=%p, frames=%d", codec, c->frames);
+    nullcodec_free(c->memTab, NULLCODEC_NMEMTAB);
+    Memory_free(heap0, c, sizeof(NullCodec));
+}
+
+/* the null codec instance is it's only memTab, on heap0: */
+VISA_Status lb_VISA_getAlgNumRecs(VISA_Handle visa, Int *numRecs)
+{
+    *numRecs = 1;
+    return VISA_EOK;
+}
+
+VISA_Status lb_VISA_getAlgMemRecs(VISA_Handle visa, IALG_MemRec *memTab,
+        Int size, Int *numRecs)
+{
+    if (size < 1) {
+        return VISA_EFAIL;
+    }
+
+    memset(memTab, 0, sizeof(*memTab));
+    memTab->size = sizeof(NullCodec);
+    memTab->base = visa;
+    *numRecs = 1;
+
+    return VISA_EOK;
+}
+
+/*
+ * Platform:
+ */
+
+void ivahd_acquire(void)
+{
+}
+
+void ivahd_release(void)
+{
+}
+
+/* no clock to scale, so always reports OPP100: */
+void ivahd_set_rate(unsigned int rate)
+{
+}
+
+void ivahd_get_stats(struct dce_ivahd_stats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->opp = stats->level = 100;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __LOOPBACK_H__
+#define __LOOPBACK_H__
+
+/*
+ * Stand-ins for the syslink/bios/CE bits used by dce.c, for the loopback
+ * build (--enable-loopback) where both halves of dce.c are linked into the
+ * host process.  The server half is built with -DSERVER -DLOOPBACK, and
+ * talks to a null codec rather than a real one, so what gets measured is
+ * the overhead of libdce itself.  See loopback.c.
+ */
+
+#include <xdc/std.h>
+#include <stdio.h>
+
+/* same layout as syslink's RcmClient_Message: */
+typedef struct {
+    UInt16 poolId;
+    UInt16 jobId;
+    UInt32 fxnIdx;
+    Int32  result;
+    UInt32 dataSize;
+    UInt32 data[1];
+} RcmClient_Message;
+
+/* just enough of Notify, SharedRegion and MultiProc for the ring transport,
+ * with the client and server half of the process standing in for the MPU
+ * and AppM3.  Doorbells are delivered synchronously, by calling the peer's
+ * callback from the thread ringing it:
+ */
+typedef UInt32 SharedRegion_SRPtr;
+typedef Void *IHeap_Handle;
+typedef Void (*Notify_FnNotifyCbck)(UInt16 procId, UInt16 lineId,
+        UInt32 eventId, UArg arg, UInt32 payload);
+
+UInt16 MultiProc_getId(String name);
+Int    Notify_registerEvent(UInt16 procId, UInt16 lineId, UInt32 eventId,
+        Notify_FnNotifyCbck fxn, UArg arg);
+Int    Notify_unregisterEvent(UInt16 procId, UInt16 lineId, UInt32 eventId,
+        Notify_FnNotifyCbck fxn, UArg arg);
+Int    Notify_sendEvent(UInt16 procId, UInt16 lineId, UInt32 eventId,
+        UInt32 payload, Bool waitClear);
+Ptr    SharedRegion_getHeap(UInt16 id);
+Ptr    SharedRegion_getPtr(SharedRegion_SRPtr srptr);
+SharedRegion_SRPtr SharedRegion_getSRPtr(Ptr addr, UInt16 id);
+Ptr    Memory_alloc(IHeap_Handle heap, SizeT size, SizeT align, Ptr eb);
+Void   Memory_free(IHeap_Handle heap, Ptr block, SizeT size);
+
+#ifdef SERVER
+
+#  define System_printf            printf
+#  define System_flush()           fflush(stdout)
+
+/* no tasks, and nothing to keep coherent, in loopback.  The task env is
+ * per thread, Task_self() is the address of it (so differs per thread, as
+ * dce_mem_account() needs), and Task_disable() is a global lock:
+ */
+extern __thread Ptr lb_task_env;
+#  define Task_self()              ((Task_Handle)&lb_task_env)
+#  define Task_setEnv(task, env)   do { (void)(task); lb_task_env = (env); } while (0)
+#  define Task_getEnv(task)        lb_task_env
+#  define Task_disable()           lb_task_disable()
+#  define Task_restore(key)        lb_task_restore(key)
+#  define Cache_wbInv(ptr, sz, type, wait)  do { } while (0)
+#  define Cache_inv(ptr, sz, type, wait)    do { } while (0)
+#  define Cache_wait()             do { } while (0)
+#  define SharedRegion_INVALIDREGIONID      0xffff
+#  define SharedRegion_getId(ptr)  SharedRegion_INVALIDREGIONID
+#  define SharedRegion_isCacheEnabled(id)   TRUE
+
+UInt lb_task_disable(Void);
+Void lb_task_restore(UInt key);
+
+/* the IVA-HD scheduler waits on a semaphore per call, and times them
+ * with Timestamp, which here counts microseconds:
+ */
+#  include <semaphore.h>
+#  include <time.h>
+typedef sem_t Semaphore_Struct;
+#  define BIOS_WAIT_FOREVER        (~0)
+#  define Semaphore_construct(s, cnt, p)    sem_init((s), 0, (cnt))
+#  define Semaphore_destruct(s)    sem_destroy(s)
+#  define Semaphore_handle(s)      (s)
+#  define Semaphore_pend(s, t)     sem_wait(s)
+#  define Semaphore_post(s)        sem_post(s)
+typedef sem_t *Semaphore_Handle;
+#  define Semaphore_create(cnt, p, eb)      lb_semaphore_create(cnt)
+#  define Semaphore_delete(s)      lb_semaphore_delete(s)
+
+Semaphore_Handle lb_semaphore_create(Int count);
+Void lb_semaphore_delete(Semaphore_Handle *sem);
+
+/* the ring transport's tasks are threads: */
+typedef struct lb_task *Task_Handle;
+typedef Void (*Task_FuncPtr)(UArg, UArg);
+typedef struct {
+    UArg   arg0;
+    UArg   arg1;
+    Ptr    env;
+    struct {
+        String name;
+    } *instance, inst;
+} Task_Params;
+#  define Task_Params_init(p)      do { memset((p), 0, sizeof(*(p))); (p)->instance = &(p)->inst; } while (0)
+#  define Task_create(fxn, p, eb)  lb_task_create((fxn), (p))
+#  define Task_delete(task)        lb_task_delete(task)
+
+Task_Handle lb_task_create(Task_FuncPtr fxn, Task_Params *params);
+Void lb_task_delete(Task_Handle *task);
+typedef struct {
+    UInt32 hi;
+    UInt32 lo;
+} Types_FreqHz;
+#  define Timestamp_getFreq(f)     do { (f)->hi = 0; (f)->lo = 1000000; } while (0)
+static inline UInt32 Timestamp_get32(Void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (UInt32)((ts.tv_sec * 1000000) + (ts.tv_nsec / 1000));
+}
+
+/* pretend heaps, the null codec allocates from them with Memory_alloc(): */
+typedef struct {
+    SizeT totalSize;
+    SizeT totalFreeSize;
+    SizeT largestFreeSize;
+} Memory_Stats;
+typedef struct LbBlock LbBlock;
+typedef struct {
+    UInt32   size;
+    UInt32   used;
+    LbBlock *blocks;      /* allocated, walked by Memory_getStats() */
+} LbHeap;
+extern LbHeap lb_heaps[2];
+#  define heap0                    ((IHeap_Handle)&lb_heaps[0])
+#  define heap1                    ((IHeap_Handle)&lb_heaps[1])
+
+Void Memory_getStats(IHeap_Handle heap, Memory_Stats *stats);
+
+/* just enough of RcmServer for dce_init(): */
+typedef Int32 (*RcmServer_MsgFxn)(UInt32, UInt32 *);
+typedef Void *RcmServer_Handle;
+typedef struct {
+    String name;
+    UInt   count;
+    Int    priority;
+} RcmServer_ThreadPoolDesc;
+typedef struct {
+    struct {
+        Int length;
+        RcmServer_ThreadPoolDesc *elem;
+    } workerPools;
+} RcmServer_Params;
+#  define Thread_Priority_NORMAL   0
+
+Void RcmServer_init(Void);
+Void RcmServer_exit(Void);
+Void RcmServer_Params_init(RcmServer_Params *params);
+Int  RcmServer_create(String name, RcmServer_Params *params,
+        RcmServer_Handle *handle);
+Int  RcmServer_delete(RcmServer_Handle *handle);
+Int  RcmServer_addSymbol(RcmServer_Handle handle, String name,
+        RcmServer_MsgFxn fxn, UInt32 *index);
+Void RcmServer_start(RcmServer_Handle handle);
+
+/* the server half calls the null codec instead of CE, and it's entry
+ * points get renamed so they don't collide with the client half:
+ */
+#  define Engine_open              lb_Engine_open
+#  define Engine_close             lb_Engine_close
+#  define VIDDEC3_create           lb_VIDDEC3_create
+#  define VIDDEC3_control          lb_VIDDEC3_control
+#  define VIDDEC3_process          lb_VIDDEC3_process
+#  define VIDDEC3_delete           lb_VIDDEC3_delete
+#  define VISA_getAlgNumRecs       lb_VISA_getAlgNumRecs
+#  define VISA_getAlgMemRecs       lb_VISA_getAlgMemRecs
+#  define dce_init                 lb_server_init
+#  define dce_deinit               lb_server_deinit
+
+int lb_server_init(void);
+int lb_server_deinit(void);
+
+#endif /* SERVER */
+
+#endif /* __LOOPBACK_H__ */
@@ -267,8 +267,6 @@ extern Int32 VIDDEC3_process(VIDDEC3_Handle handle, XDM2_BufDesc *inBufs,
     XDM2_BufDesc *outBufs, VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs);
 
 
-#if 0 /* async not yet supported */
-
 /*
  *  ======== VIDDEC3_processAsync ========
  */
@@ -309,7 +307,7 @@ extern Int32 VIDDEC3_process(VIDDEC3_Handle handle, XDM2_BufDesc *inBufs,
  *  @sa         IVIDDEC3_Fxns::process()
  */
 extern XDAS_Int32 VIDDEC3_processAsync(VIDDEC3_Handle handle,
-    XDM1_BufDesc *inBufs, XDM_BufDesc *outBufs,
+    XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
     VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs);
 
 /*
@@ -358,11 +356,9 @@ extern XDAS_Int32 VIDDEC3_processAsync(VIDDEC3_Handle handle,
  *  @sa         VIDDEC3_processAsync()
  */
 extern XDAS_Int32 VIDDEC3_processWait(VIDDEC3_Handle handle,
-    XDM1_BufDesc *inBufs, XDM_BufDesc *outBufs,
+    XDM2_BufDesc *inBufs, XDM2_BufDesc *outBufs,
     VIDDEC3_InArgs *inArgs, VIDDEC3_OutArgs *outArgs, UInt timeout);
 
-#endif
-
 
 /*@}*/  /* ingroup */
 
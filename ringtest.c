@@ -0,0 +1,264 @@
+/*
+ * Copyright (c) 2010, Texas Instruments Incorporated
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * *  Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * *  Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * *  Neither the name of Texas Instruments Incorporated nor the names of
+ *    its contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <xdc/std.h>
+
+#include "dce_ring.h"
+
+#define ERROR(FMT,...)  printf("%s:%d:\t%s\terror: " FMT "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+#define DEBUG(FMT,...)  printf("%s:%d:\t%s\tdebug: " FMT "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
+
+/*
+ * Host test for the ring transport's SPSC rings (dce_ring.h), run by 'make
+ * check'.  The same rings as between the MPU and ducati, but between two
+ * processes: the pair of rings is in a POSIX shared memory object, which
+ * each process maps for itself (so at different addresses), and an eventfd
+ * in each direction stands in for the Notify doorbell.
+ *
+ * The parent keeps the request ring as full as it can, while the child
+ * echoes each request back with a checksum, so both sides see the ring
+ * full, empty, and wrapping, and go to sleep waiting for a doorbell.
+ */
+
+#define NSLOTS     16
+#define NMSGS      1000000
+
+typedef struct {
+    Uint32 seq;
+    Uint32 val;
+    Uint32 sum;                   /* filled in by the child */
+    Uint32 pad[5];                /* make it a cache line */
+} Msg;
+
+#define RING_SIZE  ((DCE_RING_SIZE(NSLOTS, sizeof(Msg)) + \
+                        DCE_RING_CACHELINE - 1) & ~(DCE_RING_CACHELINE - 1))
+#define REQ_RING(p)  ((DceRing *)(p))
+#define RSP_RING(p)  ((DceRing *)((char *)(p) + RING_SIZE))
+
+/* a request with this seq tells the child to exit: */
+#define SEQ_STOP   0xffffffff
+
+static Uint32 checksum(Msg *m)
+{
+    return (m->seq * 2654435761U) ^ m->val;
+}
+
+static void * map_rings(const char *name, int oflag)
+{
+    void *p;
+    int fd = shm_open(name, oflag, 0600);
+
+    if (fd < 0) {
+        ERROR("shm_open failed: %d", errno);
+        return NULL;
+    }
+
+    if ((oflag & O_CREAT) && ftruncate(fd, 2 * RING_SIZE)) {
+        ERROR("ftruncate failed: %d", errno);
+        close(fd);
+        return NULL;
+    }
+
+    p = mmap(NULL, 2 * RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    return (p == MAP_FAILED) ? NULL : p;
+}
+
+static void doorbell_ring(int fd)
+{
+    uint64_t v = 1;
+    if (write(fd, &v, sizeof(v)) != sizeof(v)) {
+        ERROR("doorbell failed: %d", errno);
+    }
+}
+
+static void doorbell_wait(int fd)
+{
+    uint64_t v;
+    if ((read(fd, &v, sizeof(v)) != sizeof(v)) && (errno != EINTR)) {
+        ERROR("doorbell failed: %d", errno);
+    }
+}
+
+/* the "ducati" side, echo each request back with a checksum: */
+static int child(const char *name, int req_bell, int rsp_bell)
+{
+    void *rings = map_rings(name, O_RDWR);
+    int bells = 0;
+    Msg m;
+
+    if (!rings) {
+        return 1;
+    }
+
+    while (TRUE) {
+        if (dce_ring_get(REQ_RING(rings), &m) == 0) {
+            if (m.seq == SEQ_STOP) {
+                break;
+            }
+            m.sum = checksum(&m);
+            /* the parent never has more than NSLOTS requests in flight, so
+             * the response ring can't be full:
+             */
+            if (dce_ring_put(RSP_RING(rings), &m) > 0) {
+                doorbell_ring(rsp_bell);
+                bells++;
+            }
+        } else if (dce_ring_sleep(REQ_RING(rings))) {
+            doorbell_wait(req_bell);
+        }
+    }
+
+    DEBUG("child: %d doorbells", bells);
+
+    munmap(rings, 2 * RING_SIZE);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    char name[32];
+    void *rings;
+    int req_bell, rsp_bell, status, bells = 0, ret = 1;
+    Uint32 sent = 0, rcvd = 0;
+    pid_t p;
+    Msg m;
+
+    /* if either side gets stuck waiting for a doorbell, fail: */
+    alarm(60);
+
+    snprintf(name, sizeof(name), "/dce_ringtest.%d", (int)getpid());
+
+    rings = map_rings(name, O_RDWR | O_CREAT | O_EXCL);
+    if (!rings) {
+        return 1;
+    }
+
+    dce_ring_init(REQ_RING(rings), NSLOTS, sizeof(Msg));
+    dce_ring_init(RSP_RING(rings), NSLOTS, sizeof(Msg));
+
+    req_bell = eventfd(0, 0);
+    rsp_bell = eventfd(0, 0);
+    if ((req_bell < 0) || (rsp_bell < 0)) {
+        ERROR("eventfd failed: %d", errno);
+        goto out;
+    }
+
+    p = fork();
+    if (p < 0) {
+        ERROR("fork failed: %d", errno);
+        goto out;
+    } else if (p == 0) {
+        exit(child(name, req_bell, rsp_bell));
+    }
+
+    while (rcvd < NMSGS) {
+        Int r = -1;
+
+        /* keep the request ring full, but no more than NSLOTS in flight: */
+        if ((sent < NMSGS) && ((sent - rcvd) < NSLOTS)) {
+            m.seq = sent;
+            m.val = rand();
+            m.sum = 0;
+            r = dce_ring_put(REQ_RING(rings), &m);
+            if (r < 0) {
+                ERROR("request ring full: sent=%u, rcvd=%u", sent, rcvd);
+                goto stop;
+            }
+            if (r > 0) {
+                doorbell_ring(req_bell);
+                bells++;
+            }
+            sent++;
+        }
+
+        if (dce_ring_get(RSP_RING(rings), &m) == 0) {
+            if ((m.seq != rcvd) || (m.sum != checksum(&m))) {
+                ERROR("bad response: seq=%u (expected %u), sum=%08x",
+                        m.seq, rcvd, m.sum);
+                goto stop;
+            }
+            rcvd++;
+        } else if ((r < 0) && dce_ring_sleep(RSP_RING(rings))) {
+            /* nothing more to send, so wait for the child: */
+            doorbell_wait(rsp_bell);
+        }
+    }
+
+    if (!dce_ring_empty(REQ_RING(rings)) || !dce_ring_empty(RSP_RING(rings))) {
+        ERROR("rings not empty");
+        goto stop;
+    }
+
+    DEBUG("parent: %u messages, %d doorbells", rcvd, bells);
+
+    ret = 0;
+
+stop:
+    m.seq = SEQ_STOP;
+    if (dce_ring_put(REQ_RING(rings), &m) < 0) {
+        kill(p, SIGKILL);
+    }
+    doorbell_ring(req_bell);
+
+    if ((waitpid(p, &status, 0) != p) || !WIFEXITED(status) ||
+            WEXITSTATUS(status)) {
+        ERROR("child failed");
+        ret = 1;
+    }
+
+out:
+    if (req_bell >= 0)  close(req_bell);
+    if (rsp_bell >= 0)  close(rsp_bell);
+    munmap(rings, 2 * RING_SIZE);
+    shm_unlink(name);
+
+    printf("%s\n", ret ? "FAIL" : "PASS");
+
+    return ret;
+}
@@ -37,6 +37,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 
@@ -51,6 +53,8 @@
 #define ERROR(FMT,...)  printf("%s:%d:\t%s\terror: " FMT "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
 #define DEBUG(FMT,...)  printf("%s:%d:\t%s\tdebug: " FMT "\n", __FILE__, __LINE__, __FUNCTION__, ##__VA_ARGS__)
 #define MIN(a,b)        (((a) < (b)) ? (a) : (b))
+#define MAX(a,b)        (((a) > (b)) ? (a) : (b))
+#define DIM(a)          (sizeof((a)) / sizeof((a)[0]))
 
 /* align x to next highest multiple of 2^n */
 #define ALIGN2(x,n)   (((x) + ((1 << (n)) - 1)) & ~((1 << (n)) - 1))
@@ -71,6 +75,7 @@ XDM2_BufDesc           *inBufs    = NULL;
 XDM2_BufDesc           *outBufs   = NULL;
 VIDDEC3_InArgs         *inArgs    = NULL;
 VIDDEC3_OutArgs        *outArgs   = NULL;
+struct dce_session      session   = {0};
 
 /*! Padding for width as per Codec Requirement */
 #define PADX  32
@@ -104,21 +109,26 @@ static void * tiler_alloc(int width, int height)
 /* ************************************************************************* */
 /* utilities to allocate/manage 2d output buffers */
 
-typedef struct OutputBuffer OutputBuffer;
-
-struct OutputBuffer {
-    char *buf;     /* virtual address for local access, 4kb stride */
-    SSPtr y, uv;   /* physical addresses of Y and UV for remote access */
-    OutputBuffer *next;      /* next free buffer */
-};
-
-/* list of free buffers, not locked by codec! */
-static OutputBuffer *head = NULL;
+/* buffers come from libdce's buffer cache, and are tracked by it's frame
+ * pool, with the virtual address for local access as the frame's priv:
+ */
+static struct dce_frame_pool *pool = NULL;
+static struct dce_buffers *buffers = NULL;
 
 int output_allocate(XDM2_BufDesc *outBufs, int cnt,
         int width, int height, int stride)
 {
-    int tw, th;
+    int i;
+
+    buffers = dce_buffers_get(MIN(cnt, DCE_MAX_BUFFERS), width, height, stride);
+    if (!buffers) {
+        return -1;
+    }
+
+    pool = dce_frame_pool_create(buffers->cnt);
+    if (!pool) {
+        return -1;
+    }
 
     outBufs->numBufs = 2;
 
@@ -126,16 +136,12 @@ int output_allocate(XDM2_BufDesc *outBufs, int cnt,
         /* non-2d allocation! */
         int size_y = stride * height;
         int size_uv = stride * height / 2;
-        tw = size_y + size_uv;
-        th = 0;
         outBufs->descs[0].memType = XDM_MEMTYPE_TILEDPAGE;
         outBufs->descs[0].bufSize.bytes = size_y;
         outBufs->descs[1].memType = XDM_MEMTYPE_TILEDPAGE;
         outBufs->descs[1].bufSize.bytes = size_uv;
 
     } else {
-        tw = width;
-        th = height;
         outBufs->descs[0].memType = XDM_MEMTYPE_TILED8;
         outBufs->descs[0].bufSize.tileMem.width  = width;
         outBufs->descs[0].bufSize.tileMem.height = height;
@@ -144,19 +150,14 @@ int output_allocate(XDM2_BufDesc *outBufs, int cnt,
         outBufs->descs[1].bufSize.tileMem.height = height / 2;
     }
 
-    while (cnt) {
-        OutputBuffer *buf = calloc(sizeof(OutputBuffer), 1);
-
-        buf->buf = tiler_alloc(tw, th);
-        buf->y   = TilerMem_VirtToPhys(buf->buf);
-        buf->uv  = TilerMem_VirtToPhys(buf->buf + (height * stride));
+    for (i = 0; i < buffers->cnt; i++) {
+        struct dce_buffer *buf = &buffers->bufs[i];
 
-        DEBUG("buf=%p, y=%08x, uv=%08x", buf, buf->y, buf->uv);
+        DEBUG("buf=%p, y=%p, uv=%p", buf->buf, buf->y, buf->uv);
 
-        buf->next = head;
-        head = buf;
-
-        cnt--;
+        if (!dce_frame_pool_add(pool, buf->y, buf->uv, buf->buf)) {
+            return -1;
+        }
     }
 
     return 0;
@@ -164,29 +165,16 @@ int output_allocate(XDM2_BufDesc *outBufs, int cnt,
 
 void output_free(void)
 {
-    OutputBuffer *buf = head;
-    while ((buf=head)) {
-        MemMgr_Free(buf->buf);
-        head = buf->next;
-        free(buf);
+    if (pool) {
+        dce_frame_pool_delete(pool);
+        pool = NULL;
     }
-}
 
-OutputBuffer * output_get(void)
-{
-    OutputBuffer *buf = head;
-    if (buf) {
-        head = buf->next;
+    /* kept for the next stream of the same size: */
+    if (buffers) {
+        dce_buffers_put(buffers);
+        buffers = NULL;
     }
-    DEBUG("get: %p", buf);
-    return buf;
-}
-
-void output_release(OutputBuffer *buf)
-{
-    DEBUG("release: %p", buf);
-    buf->next = head;
-    head = buf;
 }
 
 /* ************************************************************************* */
@@ -282,6 +270,167 @@ suseconds_t mark(suseconds_t *last)
     return t.tv_usec;
 }
 
+/* for startup latency breakdown, unlike mark() doesn't wrap each second */
+static unsigned long usecs(unsigned long long start)
+{
+    struct timeval t;
+    gettimeofday(&t, NULL);
+    return ((t.tv_sec * 1000000ULL) + t.tv_usec) - start;
+}
+
+/* time creating and deleting another instance of the codec, n times.
+ * This is done with ducati walking the heaps on every memTab alloc/free
+ * (see dce_set_mem_walk()), as it used to, and then without, to compare:
+ */
+static void bench_create(int n)
+{
+    unsigned long long t;
+    struct dce_mem_stats mem;
+    int i, walk;
+
+    for (walk = 1; walk >= 0; walk--) {
+        unsigned long t_create = 0, t_delete = 0;
+
+        if (dce_set_mem_walk(walk) < 0) {
+            ERROR("fail");
+            return;
+        }
+
+        for (i = 0; i < n; i++) {
+            VIDDEC3_Handle c;
+
+            t = usecs(0);
+            c = VIDDEC3_create(engine, "ivahd_h264dec", params);
+            t_create += usecs(t);
+
+            if (!c) {
+                ERROR("fail: after %d", i);
+                dce_set_mem_walk(0);
+                return;
+            }
+
+            t = usecs(0);
+            VIDDEC3_delete(c);
+            t_delete += usecs(t);
+        }
+
+        DEBUG("create: %s: %d iterations, VIDDEC3_create=%luus, "
+                "VIDDEC3_delete=%luus", walk ? "heap walks" : "counters",
+                n, t_create / n, t_delete / n);
+    }
+
+    if (!dce_get_mem_stats(NULL, &mem)) {
+        DEBUG("create: heapvideo peak=%u, allocs=%u, largest failed=%u",
+                mem.peak[DCE_MEM_HEAP1], mem.allocs[DCE_MEM_HEAP1],
+                mem.failed[DCE_MEM_HEAP1]);
+    }
+}
+
+/* create and delete codecs, up to 4 at a time, at a random mix of
+ * resolutions, and see how fragmented heapvideo gets over time.  The mix
+ * only depends on n, so runs can be compared:
+ */
+static void stress(int n)
+{
+    static const struct {
+        int w, h;
+    } res[] = {
+            { 176, 144 }, { 320, 240 }, { 640, 480 },
+            { 720, 576 }, { 1280, 720 }, { 1920, 1088 },
+    };
+    VIDDEC3_Handle codecs[4] = {0};
+    struct dce_mem_stats mem;
+    int i, fails = 0;
+
+    srand(n);
+
+    for (i = 0; i < n; i++) {
+        int k = rand() % DIM(codecs);
+
+        if (codecs[k]) {
+            VIDDEC3_delete(codecs[k]);
+            codecs[k] = NULL;
+        } else {
+            int r = rand() % DIM(res);
+            params->maxWidth  = res[r].w;
+            params->maxHeight = res[r].h;
+            codecs[k] = VIDDEC3_create(engine, "ivahd_h264dec", params);
+            if (!codecs[k]) {
+                fails++;
+            }
+        }
+
+        if ((((i + 1) % 100) == 0) || ((i + 1) == n)) {
+            unsigned int avail;
+
+            if (dce_get_mem_stats(NULL, &mem)) {
+                ERROR("fail");
+                break;
+            }
+
+            /* fragmentation is the free memory not in the largest block: */
+            avail = mem.heap[1].size - mem.heap[1].used;
+            DEBUG("stress: %d: used=%u, free=%u, largest=%u, "
+                    "fragmentation=%u%%, failures=%d", i + 1,
+                    mem.heap[1].used, avail, mem.heap[1].max_block,
+                    avail ? 100 - (unsigned int)((mem.heap[1].max_block *
+                            100ULL) / avail) : 0, fails);
+        }
+    }
+
+    for (i = 0; i < DIM(codecs); i++) {
+        if (codecs[i]) {
+            VIDDEC3_delete(codecs[i]);
+        }
+    }
+
+    params->maxWidth  = width;
+    params->maxHeight = height;
+}
+
+/* open an engine, create and delete a codec, and close the engine again,
+ * n times, instead of decoding.  Each cycle adds and removes this client's
+ * entry in the server's registry, so with -p it is a stress test of that,
+ * from many pids at once.  Returns the number of failed cycles:
+ */
+static int create_loop(int n)
+{
+    unsigned long long t, start = usecs(0);
+    unsigned long worst = 0;
+    int i, fails = 0;
+
+    for (i = 0; i < n; i++) {
+        Engine_Handle e;
+        VIDDEC3_Handle c = NULL;
+        Engine_Error ec;
+
+        t = usecs(0);
+
+        e = Engine_open("ivahd_vidsvr", NULL, &ec);
+        if (e) {
+            c = VIDDEC3_create(e, "ivahd_h264dec", params);
+        }
+
+        if (c) {
+            VIDDEC3_delete(c);
+        } else {
+            ERROR("fail: pid=%d, cycle %d, ec=%d", getpid(), i, (int)ec);
+            fails++;
+        }
+
+        if (e) {
+            Engine_close(e);
+        }
+
+        worst = MAX(worst, usecs(t));
+    }
+
+    DEBUG("loop: pid=%d, %d cycles, %luus per cycle, worst=%luus, failures=%d",
+            getpid(), n, usecs(start) / n, worst, fails);
+
+    return fails;
+}
+
 /* decoder body */
 int main(int argc, char **argv)
 {
@@ -291,17 +440,61 @@ int main(int argc, char **argv)
     char *in_pattern, *out_pattern;
     int in_cnt = 0, out_cnt = 0;
     int oned, stride;
-
-    if ((argc >= 2) && !strcmp(argv[1],"-1")) {
-        oned = TRUE;
+    unsigned long long start = usecs(0);
+    unsigned long t_preinit, t_open, t_create, t_control;
+    struct dce_mem_stats mem;
+    int preinit = FALSE;
+    int ncreate = 0, nstress = 0, nloop = 0;
+    int nprocs = 1, children = 0;
+    int fps = 0, weight = 0;
+    int ret = 0;
+
+    oned = FALSE;
+
+    while ((argc >= 2) && (argv[1][0] == '-')) {
+        if (!strcmp(argv[1],"-1")) {
+            oned = TRUE;
+        } else if (!strcmp(argv[1],"-c") && (argc >= 3)) {
+            /* benchmark VIDDEC3_create() before decoding: */
+            ncreate = atoi(argv[2]);
+            argc--;
+            argv++;
+        } else if (!strcmp(argv[1],"-s") && (argc >= 3)) {
+            /* create/delete stress test, instead of decoding: */
+            nstress = atoi(argv[2]);
+            argc--;
+            argv++;
+        } else if (!strcmp(argv[1],"-l") && (argc >= 3)) {
+            /* engine/codec create/delete loop, instead of decoding: */
+            nloop = atoi(argv[2]);
+            argc--;
+            argv++;
+        } else if (!strcmp(argv[1],"-r") && (argc >= 3)) {
+            /* frame rate hint, for the IVA-HD clock governor: */
+            fps = atoi(argv[2]);
+            argc--;
+            argv++;
+        } else if (!strcmp(argv[1],"-w") && (argc >= 3)) {
+            /* share of the IVA-HD, ie. with -p, against other dcetest's: */
+            weight = atoi(argv[2]);
+            argc--;
+            argv++;
+        } else if (!strcmp(argv[1],"-p") && (argc >= 3)) {
+            /* run in several processes at once, ie. with -c, -s or -l
+             * to stress the server with many clients:
+             */
+            nprocs = atoi(argv[2]);
+            argc--;
+            argv++;
+        } else {
+            break;
+        }
         argc--;
         argv++;
-    } else {
-        oned = FALSE;
     }
 
     if (argc != 5) {
-        printf("usage:   %s width height inpattern outpattern\n", argv[0]);
+        printf("usage:   %s [-1] [-c count] [-s count] [-l count] [-p nprocs] [-r fps] [-w weight] width height inpattern outpattern\n", argv[0]);
         printf("example: %s 320 240 in.%%d.h264 out.%%04d.yuv\n", argv[0]);
         return 1;
     }
@@ -330,6 +523,29 @@ int main(int argc, char **argv)
     DEBUG ("padded_width=%d, padded_height=%d, stride=%d, num_buffers=%d",
             padded_width, padded_height, stride, num_buffers);
 
+    /* fork before connecting to ducati, each process is a new client: */
+    while ((children + 1) < nprocs) {
+        pid_t p = fork();
+        if (p < 0) {
+            ERROR("fork failed: %d", errno);
+            break;
+        } else if (p == 0) {
+            children = 0;
+            break;
+        }
+        children++;
+    }
+
+    start = usecs(0);
+
+    if (dce_preinit()) {
+        ERROR("fail");
+        goto out;
+    }
+    preinit = TRUE;
+
+    t_preinit = usecs(start);
+
     engine = Engine_open("ivahd_vidsvr", NULL, &ec);
 
     if (!engine) {
@@ -337,8 +553,21 @@ int main(int argc, char **argv)
         goto out;
     }
 
-    params = dce_alloc(sizeof(IVIDDEC3_Params));
-    params->size = sizeof(IVIDDEC3_Params);
+    t_open = usecs(start);
+
+    /* all the control structures, in one allocation: */
+    if (dce_session_alloc(&session, NULL)) {
+        ERROR("fail");
+        goto out;
+    }
+
+    params    = session.params;
+    dynParams = session.dynParams;
+    status    = session.status;
+    inBufs    = session.inBufs;
+    outBufs   = session.outBufs;
+    inArgs    = session.inArgs;
+    outArgs   = session.outArgs;
 
     params->maxWidth         = width;
     params->maxHeight        = height;
@@ -358,6 +587,19 @@ int main(int argc, char **argv)
     params->numOutputDataUnits = 0;
     params->errorInfoMode    = IVIDEO_ERRORINFO_OFF;
 
+    if (nstress > 0) {
+        stress(nstress);
+        goto out;
+    }
+
+    if (nloop > 0) {
+        /* without our own engine open, so it is only the loop's: */
+        Engine_close(engine);
+        engine = NULL;
+        ret = create_loop(nloop) ? 1 : 0;
+        goto out;
+    }
+
     codec = VIDDEC3_create(engine, "ivahd_h264dec", params);
 
     if (!codec) {
@@ -365,8 +607,25 @@ int main(int argc, char **argv)
         goto out;
     }
 
-    dynParams = dce_alloc(sizeof(IVIDDEC3_DynamicParams));
-    dynParams->size = sizeof(IVIDDEC3_DynamicParams);
+    t_create = usecs(start);
+
+    if ((fps > 0) && dce_set_frame_period(codec, 1000000 / fps)) {
+        ERROR("fail");
+    }
+
+    /* with a frame rate, each frame is due within a frame period: */
+    if (fps > 0) {
+        dce_set_deadline(codec, 1000000 / fps);
+    }
+
+    if ((weight > 0) && dce_set_weight(codec, weight)) {
+        ERROR("fail");
+    }
+
+    if (ncreate > 0) {
+        bench_create(ncreate);
+        start = usecs(0) - t_create;  /* leave it out of the breakdown */
+    }
 
     dynParams->decodeHeader  = XDM_DECODE_AU;
 
@@ -376,9 +635,6 @@ int main(int argc, char **argv)
     dynParams->newFrameFlag  = XDAS_TRUE;
 
 
-    status = dce_alloc(sizeof(IVIDDEC3_Status));
-    status->size = sizeof(IVIDDEC3_Status);
-
     err = VIDDEC3_control(codec, XDM_SETPARAMS, dynParams, status);
     if (err) {
         ERROR("fail: %d", err);
@@ -392,14 +648,18 @@ int main(int argc, char **argv)
         goto out;
     }
 
-    inBufs = dce_alloc(sizeof(XDM2_BufDesc));
+    t_control = usecs(start);
+
     inBufs->numBufs = 1;
     input = tiler_alloc(width * height, 0);
-    inBufs->descs[0].buf = (XDAS_Int8 *)TilerMem_VirtToPhys(input);
+    /* registered, so the host address can be passed to the codec: */
+    if (dce_register_buffer(input, width * height)) {
+        ERROR("fail");
+        goto out;
+    }
+    inBufs->descs[0].buf = (XDAS_Int8 *)input;
     inBufs->descs[0].memType = XDM_MEMTYPE_RAW;
 
-    outBufs = dce_alloc(sizeof(XDM2_BufDesc));
-
     err = output_allocate(outBufs, num_buffers,
             padded_width, padded_height, stride);
     if (err) {
@@ -407,18 +667,12 @@ int main(int argc, char **argv)
         goto out;
     }
 
-    inArgs = dce_alloc(sizeof(IVIDDEC3_InArgs));
-    inArgs->size = sizeof(IVIDDEC3_InArgs);
-
-    outArgs = dce_alloc(sizeof(IVIDDEC3_OutArgs));
-    outArgs->size = sizeof(IVIDDEC3_OutArgs);
-
     while (inBufs->numBufs && outBufs->numBufs) {
-        OutputBuffer *buf;
+        struct dce_frame *buf, *display[DIM(outArgs->outputID)];
         int n, i;
         suseconds_t t;
 
-        buf = output_get();
+        buf = dce_frame_get(pool);
         if (!buf) {
             ERROR("fail: out of buffers");
             goto shutdown;
@@ -436,39 +690,53 @@ int main(int argc, char **argv)
             inArgs->inputID = 0;
         }
 
-        inArgs->inputID = (XDAS_Int32)buf;
-        outBufs->descs[0].buf = (XDAS_Int8 *)buf->y;
-        outBufs->descs[1].buf = (XDAS_Int8 *)buf->uv;
+        inArgs->inputID = buf->id;
+        outBufs->descs[0].buf = buf->y;
+        outBufs->descs[1].buf = buf->uv;
 
         t = mark(NULL);
         err = VIDDEC3_process(codec, inBufs, outBufs, inArgs, outArgs);
         DEBUG("processed returned in: %dus", (int)mark(&t));
+
+        if (start) {
+            /* cumulative, so each is the latency up to that point: */
+            DEBUG("startup: preinit=%luus, Engine_open=%luus, VIDDEC3_create=%luus, "
+                    "VIDDEC3_control=%luus, first VIDDEC3_process=%luus",
+                    t_preinit, t_open, t_create, t_control, usecs(start));
+            start = 0;
+
+            if (!dce_get_mem_stats(codec, &mem)) {
+                DEBUG("memory: codec heap0=%u, heap1=%u (tiled=%u), "
+                        "heapvideo %u of %u free, host tiler=%u",
+                        mem.codec[DCE_MEM_HEAP0], mem.codec[DCE_MEM_HEAP1],
+                        mem.codec[DCE_MEM_TILED],
+                        mem.heap[1].size - mem.heap[1].used,
+                        mem.heap[1].size, mem.host_tiler);
+            }
+        }
         if (err) {
             ERROR("process returned error: %d", err);
             ERROR("extendedError: %08x", outArgs->extendedError);
             goto shutdown;
         }
 
-        for (i = 0; outArgs->outputID[i]; i++) {
+        /* frames to display, and release those the codec is done with (or
+         * hold on to the one it is still using):
+         */
+        n = dce_frame_pool_update(pool, outArgs, display, DIM(display));
+
+        for (i = 0; i < n; i++) {
             /* calculate offset to region of interest */
             XDM_Rect *r = &(outArgs->displayBufs.bufDesc[0].activeFrameRegion);
             int yoff  = (r->topLeft.y * stride) + r->topLeft.x;
             int uvoff = (r->topLeft.y * stride / 2) + r->topLeft.x;
+            char *p = display[i]->priv;
 
-            /* get the output buffer and write it to file */
-            buf = (OutputBuffer *)outArgs->outputID[i];
-            DEBUG("pop: %d (%p)", out_cnt, buf);
-            write_output(out_pattern, out_cnt++, buf->buf + yoff,
-                    buf->buf + uvoff + stride * padded_height, stride);
-        }
-
-        for (i = 0; outArgs->freeBufID[i]; i++) {
-            buf = (OutputBuffer *)outArgs->freeBufID[i];
-            output_release(buf);
-        }
-
-        if (outArgs->outBufsInUseFlag) {
-            DEBUG("TODO... outBufsInUseFlag"); // XXX
+            /* write the output buffer to file, and drop our reference */
+            DEBUG("pop: %d (%p)", out_cnt, display[i]);
+            write_output(out_pattern, out_cnt++, p + yoff,
+                    p + uvoff + stride * padded_height, stride);
+            dce_frame_unref(display[i]);
         }
     }
 
@@ -476,18 +744,41 @@ shutdown:
 
     VIDDEC3_delete(codec);
 
+    {
+        struct dce_msgcache_stats stats;
+        dce_get_msgcache_stats(&stats);
+        DEBUG("msgcache: hits=%u, allocs=%u, alloc_failures=%u, exhausted=%u",
+                stats.hits, stats.allocs, stats.alloc_failures, stats.exhausted);
+    }
+
+    {
+        struct dce_ivahd_stats stats;
+        if (!dce_get_ivahd_stats(&stats)) {
+            DEBUG("ivahd: OPP0=%ums, OPP50=%ums, OPP100=%ums, switches=%u, "
+                    "load=%u%%", stats.opp_ms[0], stats.opp_ms[1],
+                    stats.opp_ms[2], stats.switches, stats.load);
+        }
+    }
+
 out:
     if (engine)         Engine_close(engine);
-    if (params)         dce_free(params);
-    if (dynParams)      dce_free(dynParams);
-    if (status)         dce_free(status);
-    if (inBufs)         dce_free(inBufs);
-    if (outBufs)        dce_free(outBufs);
-    if (inArgs)         dce_free(inArgs);
-    if (outArgs)        dce_free(outArgs);
-    if (input)          MemMgr_Free(input);
+    if (preinit)        dce_preinit_release();
+    dce_session_free(&session);
+    if (input) {
+        dce_unregister_buffer(input);
+        MemMgr_Free(input);
+    }
 
     output_free();
 
-    return 0;
+    /* and fail if any of the other processes did: */
+    while (children-- > 0) {
+        int status;
+        if ((wait(&status) < 0) || !WIFEXITED(status) ||
+                WEXITSTATUS(status)) {
+            ret = 1;
+        }
+    }
+
+    return ret;
 }